@@ -0,0 +1,89 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico.h"
+
+// Transfers to the SPI bus run on a thread per channel, feeding it at its baud
+// rate. Others only feed the sniffer, and are done right away.
+#define NUM_DMA_CHANNELS 12
+
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC32 0x0
+#define DMA_SNIFF_CTRL_CALC_VALUE_CRC32R 0x1
+
+enum dma_channel_transfer_size
+{
+    DMA_SIZE_8 = 0,
+    DMA_SIZE_16 = 1,
+    DMA_SIZE_32 = 2,
+};
+
+typedef struct
+{
+    uint dreq;
+    bool sniff;
+} dma_channel_config;
+
+int dma_claim_unused_channel(bool required);
+
+inline dma_channel_config dma_channel_get_default_config(uint /* channel */)
+{
+    return {};
+}
+
+inline void channel_config_set_transfer_data_size(dma_channel_config * /* c */,
+                                                  enum dma_channel_transfer_size /* size */)
+{
+}
+
+inline void channel_config_set_read_increment(dma_channel_config * /* c */, bool /* incr */)
+{
+}
+
+inline void channel_config_set_write_increment(dma_channel_config * /* c */, bool /* incr */)
+{
+}
+
+inline void channel_config_set_dreq(dma_channel_config *c, uint dreq)
+{
+    c->dreq = dreq;
+}
+
+inline void channel_config_set_sniff_enable(dma_channel_config *c, bool sniff_enable)
+{
+    c->sniff = sniff_enable;
+}
+
+// Only byte transfers from memory are supported, and only SPI data registers
+// receive what is written
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger);
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count);
+void dma_channel_wait_for_finish_blocking(uint channel);
+
+// Only the CRC-32 modes are supported
+void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable);
+void dma_sniffer_set_output_reverse_enabled(bool enable);
+void dma_sniffer_set_output_invert_enabled(bool enable);
+void dma_sniffer_set_data_accumulator(uint32_t seed_value);
+uint32_t dma_sniffer_get_data_accumulator();
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled);
+bool dma_channel_get_irq1_status(uint channel);
+void dma_channel_acknowledge_irq1(uint channel);
@@ -0,0 +1,54 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico.h"
+
+// Only the registers the firmware touches
+typedef struct
+{
+    volatile uint32_t dr;
+    volatile uint32_t icr;
+} spi_hw_t;
+
+typedef struct spi_inst spi_inst_t;
+
+extern spi_inst_t *const spi0;
+extern spi_inst_t *const spi1;
+
+#define SPI_SSPICR_RORIC_BITS 0x00000001
+
+uint spi_init(spi_inst_t *spi, uint baudrate);
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate);
+uint spi_get_baudrate(const spi_inst_t *spi);
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len);
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len);
+spi_hw_t *spi_get_hw(spi_inst_t *spi);
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx);
+
+// Writes complete before they return, so the bus is never left busy
+inline bool spi_is_busy(const spi_inst_t * /* spi */)
+{
+    return false;
+}
+
+inline bool spi_is_readable(const spi_inst_t * /* spi */)
+{
+    return false;
+}
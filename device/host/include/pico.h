@@ -0,0 +1,66 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Host build of the parts of the Pico SDK the firmware uses, so its logic can
+// run on Linux against mock hardware and a real network.
+
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define PICO_ON_DEVICE 0
+#define PICO_SDK_VERSION_STRING "host"
+
+typedef unsigned int uint;
+
+#define PICO_OK 0
+#define PICO_ERROR_GENERIC -1
+#define PICO_ERROR_TIMEOUT -2
+#define PICO_ERROR_BADAUTH -7
+#define PICO_ERROR_CONNECT_FAILED -8
+
+// Like the SDK's, always evaluates the condition, even with NDEBUG
+static inline void hard_assert(bool condition)
+{
+    if (!condition)
+    {
+        fprintf(stderr, "Hard assert\n");
+        abort();
+    }
+}
+
+#define __not_in_flash_func(func) func
+#define __time_critical_func(func) func
+
+// Kept in a section of its own that survives a watchdog reboot, like RAM that
+// isn't cleared at startup, see host/src/platform.cpp
+#define __uninitialized_ram(group) __attribute__((section("uninitialized_data"))) group
+
+// Flash is backed by a file mapped into memory, see host/src/flash.cpp
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+#define XIP_BASE (host_flash_base())
+
+uintptr_t host_flash_base();
+
+inline void tight_loop_contents()
+{
+}
@@ -0,0 +1,33 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico/stdlib.h"
+
+// The network is driven by polling its sockets, see host/src/network.cpp
+typedef struct async_context
+{
+    int unused;
+} async_context_t;
+
+// Handles any network events that are ready
+void async_context_poll(async_context_t *context);
+
+// Waits until a network event is ready or `ms` have passed
+void async_context_wait_for_work_ms(async_context_t *context, uint32_t ms);
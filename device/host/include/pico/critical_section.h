@@ -0,0 +1,44 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <mutex>
+
+#include "pico.h"
+
+// A mutex stands in for the spin lock, since both cores are threads
+typedef struct critical_section
+{
+    std::mutex *mutex;
+} critical_section_t;
+
+inline void critical_section_init(critical_section_t *crit_sec)
+{
+    crit_sec->mutex = new std::mutex();
+}
+
+inline void critical_section_enter_blocking(critical_section_t *crit_sec)
+{
+    crit_sec->mutex->lock();
+}
+
+inline void critical_section_exit(critical_section_t *crit_sec)
+{
+    crit_sec->mutex->unlock();
+}
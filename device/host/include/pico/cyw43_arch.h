@@ -0,0 +1,103 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico/async_context.h"
+#include "pico/stdlib.h"
+
+// The host's own network connection stands in for the Wi-Fi chip
+typedef struct cyw43
+{
+    int unused;
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+
+#define CYW43_NONE_PM 0xa11140
+#define CYW43_AGGRESSIVE_PM 0xa11c82
+#define CYW43_PERFORMANCE_PM 0x111022
+#define CYW43_DEFAULT_PM CYW43_PERFORMANCE_PM
+
+async_context_t *cyw43_arch_async_context();
+
+void cyw43_arch_lwip_begin();
+void cyw43_arch_lwip_end();
+
+inline int cyw43_wifi_pm(cyw43_t * /* self */, uint32_t /* pm */)
+{
+    return 0;
+}
+
+// The Wi-Fi API of the Pico SDK, as far as the device's wifi.cpp uses it. The
+// host firmware doesn't call it, see src/wifi.cpp; test_wifi_join implements
+// it with a simulated chip and access point.
+
+#define CYW43_ITF_STA 0
+
+#define CYW43_AUTH_OPEN 0
+#define CYW43_AUTH_WPA_TKIP_PSK 0x00200002
+#define CYW43_AUTH_WPA2_AES_PSK 0x00400004
+#define CYW43_AUTH_WPA2_MIXED_PSK 0x00400006
+
+#define CYW43_CHANNEL_NONE 0xffffffff
+
+#define CYW43_LINK_DOWN 0
+#define CYW43_LINK_JOIN 1
+#define CYW43_LINK_NOIP 2
+#define CYW43_LINK_UP 3
+#define CYW43_LINK_FAIL -1
+#define CYW43_LINK_NONET -2
+#define CYW43_LINK_BADAUTH -3
+
+typedef struct _cyw43_wifi_scan_options_t
+{
+    uint32_t version;
+    uint16_t action;
+    uint16_t _;
+    uint32_t ssid_len;
+    uint8_t ssid[32];
+    int8_t scan_type;
+} cyw43_wifi_scan_options_t;
+
+typedef struct _cyw43_ev_scan_result_t
+{
+    uint8_t bssid[6];
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    uint16_t channel;
+    uint8_t auth_mode;
+    int16_t rssi;
+} cyw43_ev_scan_result_t;
+
+int cyw43_arch_init();
+void cyw43_arch_enable_sta_mode();
+void cyw43_arch_poll();
+void cyw43_arch_wait_for_work_until(absolute_time_t until);
+
+int cyw43_arch_wifi_connect_bssid_timeout_ms(const char *ssid, const uint8_t *bssid, const char *pw, uint32_t auth,
+                                             uint32_t timeout);
+int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth);
+
+int cyw43_wifi_scan(cyw43_t *self, cyw43_wifi_scan_options_t *opts, void *env,
+                    int (*result_cb)(void *, const cyw43_ev_scan_result_t *));
+bool cyw43_wifi_scan_active(cyw43_t *self);
+int cyw43_wifi_join(cyw43_t *self, size_t ssid_len, const uint8_t *ssid, size_t key_len, const uint8_t *key,
+                    uint32_t auth_type, const uint8_t *bssid, uint32_t channel);
+int cyw43_wifi_leave(cyw43_t *self, int itf);
+int cyw43_tcpip_link_status(cyw43_t *self, int itf);
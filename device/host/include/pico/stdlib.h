@@ -0,0 +1,80 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "hardware/gpio.h"
+#include "pico.h"
+
+typedef uint64_t absolute_time_t;
+
+bool stdio_init_all();
+
+uint64_t time_us_64();
+uint32_t time_us_32();
+
+inline absolute_time_t get_absolute_time()
+{
+    return time_us_64();
+}
+
+inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to)
+{
+    return (int64_t)(to - from);
+}
+
+inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us)
+{
+    return t + us;
+}
+
+inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms)
+{
+    return t + ms * 1000ull;
+}
+
+inline absolute_time_t make_timeout_time_us(uint64_t us)
+{
+    return delayed_by_us(get_absolute_time(), us);
+}
+
+inline absolute_time_t make_timeout_time_ms(uint32_t ms)
+{
+    return delayed_by_ms(get_absolute_time(), ms);
+}
+
+inline bool time_reached(absolute_time_t t)
+{
+    return get_absolute_time() >= t;
+}
+
+inline uint32_t to_ms_since_boot(absolute_time_t t)
+{
+    return (uint32_t)(t / 1000);
+}
+
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+void sleep_until(absolute_time_t t);
+
+// Events between the cores, which are threads on the host
+void __sev();
+void __wfe();
+bool best_effort_wfe_or_timeout(absolute_time_t timeout);
+
+uint get_core_num();
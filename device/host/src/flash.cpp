@@ -0,0 +1,147 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Flash, backed by a file so saved state and cached frames survive restarts.
+// The file is EHYMNBOARD_FLASH, or flash.bin in the working directory.
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <mutex>
+
+#include "hardware/flash.h"
+#include "pico/flash.h"
+
+#include "mock_hardware.h"
+
+static std::mutex flash_mutex;
+
+// Bytes that can still be erased or programmed before the power is cut, or
+// -1 while it stays on
+static int64_t power_left = -1;
+
+static uint8_t *map_flash()
+{
+    const char *path = getenv("EHYMNBOARD_FLASH");
+
+    if (!path)
+    {
+        path = "flash.bin";
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    struct stat st;
+
+    if (fd < 0 || fstat(fd, &st) != 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    bool is_new = st.st_size == 0;
+
+    if (ftruncate(fd, PICO_FLASH_SIZE_BYTES) != 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    auto flash = (uint8_t *)mmap(nullptr, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (flash == MAP_FAILED)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (is_new)
+    {
+        memset(flash, 0xFF, PICO_FLASH_SIZE_BYTES);
+    }
+
+    return flash;
+}
+
+uintptr_t host_flash_base()
+{
+    // Mapped on first use, as saved state is read during static initialization
+    static uint8_t *flash = map_flash();
+    return (uintptr_t)flash;
+}
+
+void host_flash_cut_after(size_t bytes)
+{
+    power_left = bytes;
+}
+
+// Ends the program like a power cut once the bytes allowed by
+// host_flash_cut_after() have been written. What has been written stays in
+// the file.
+static void use_power()
+{
+    if (power_left == 0)
+    {
+        _exit(HOST_POWER_CUT_STATUS);
+    }
+
+    if (power_left > 0)
+    {
+        power_left--;
+    }
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    hard_assert(flash_offs % FLASH_SECTOR_SIZE == 0 && count % FLASH_SECTOR_SIZE == 0);
+    hard_assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+
+    auto flash = (uint8_t *)host_flash_base() + flash_offs;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        use_power();
+        flash[i] = 0xFF;
+    }
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count)
+{
+    hard_assert(flash_offs % FLASH_PAGE_SIZE == 0 && count % FLASH_PAGE_SIZE == 0);
+    hard_assert(flash_offs + count <= PICO_FLASH_SIZE_BYTES);
+
+    // Programming can only clear bits, like real flash
+    auto flash = (uint8_t *)host_flash_base() + flash_offs;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        use_power();
+        flash[i] &= data[i];
+    }
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t /* enter_exit_timeout_ms */)
+{
+    std::lock_guard<std::mutex> lock(flash_mutex);
+    func(param);
+    return PICO_OK;
+}
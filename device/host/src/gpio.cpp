@@ -0,0 +1,183 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// GPIO pins. Inputs read the mock device driving them, and edge interrupts
+// are raised by sampling the inputs that have them enabled. Reading such an
+// input samples it too, so a pulse the firmware saw isn't missed by the sampler.
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+#include "hardware/irq.h"
+#include "mock_hardware.h"
+
+constexpr auto EDGE_SAMPLE_INTERVAL = std::chrono::microseconds(100);
+
+struct Pin
+{
+    std::atomic<bool> level{false};
+    bool is_output = false;
+    std::function<bool()> source;
+    std::function<void(bool)> watcher;
+
+    std::atomic<uint32_t> irq_mask{0};
+    std::atomic<uint32_t> irq_events{0};
+    std::atomic<bool> sampled_level{false};
+    std::atomic<bool> edge_pending{false};
+};
+
+// Function local, as mock devices attach during static initialization
+static Pin &pin(uint gpio)
+{
+    static Pin pins[NUM_BANK0_GPIOS];
+
+    hard_assert(gpio < NUM_BANK0_GPIOS);
+    return pins[gpio];
+}
+
+void host_gpio_drive(uint gpio, std::function<bool()> source)
+{
+    pin(gpio).source = source;
+}
+
+void host_gpio_watch(uint gpio, std::function<void(bool)> watcher)
+{
+    pin(gpio).watcher = watcher;
+}
+
+bool host_gpio_level(uint gpio)
+{
+    return pin(gpio).level;
+}
+
+void gpio_set_function(uint gpio, enum gpio_function /* fn */)
+{
+    hard_assert(gpio < NUM_BANK0_GPIOS);
+}
+
+void gpio_set_dir(uint gpio, bool out)
+{
+    pin(gpio).is_output = out;
+}
+
+void gpio_put(uint gpio, bool value)
+{
+    auto &p = pin(gpio);
+    p.level = value;
+
+    if (p.watcher)
+    {
+        p.watcher(value);
+    }
+}
+
+// Records an edge if the level changed since the last sample. The sampler
+// thread raises the interrupt for it.
+static void sample_level(Pin &p, bool level)
+{
+    auto mask = p.irq_mask.load();
+
+    if (mask == 0 || level == p.sampled_level.exchange(level))
+    {
+        return;
+    }
+
+    uint32_t edge = level ? GPIO_IRQ_EDGE_RISE : GPIO_IRQ_EDGE_FALL;
+
+    if (mask & edge)
+    {
+        p.irq_events |= edge;
+        p.edge_pending = true;
+    }
+}
+
+bool gpio_get(uint gpio)
+{
+    auto &p = pin(gpio);
+
+    if (!p.is_output && p.source)
+    {
+        bool level = p.source();
+        sample_level(p, level);
+        return level;
+    }
+
+    return p.level;
+}
+
+static void sample_edges()
+{
+    while (true)
+    {
+        bool raise = false;
+
+        for (uint gpio = 0; gpio < NUM_BANK0_GPIOS; gpio++)
+        {
+            auto &p = pin(gpio);
+
+            if (p.irq_mask != 0)
+            {
+                gpio_get(gpio);
+            }
+
+            if (p.edge_pending.exchange(false))
+            {
+                raise = true;
+            }
+        }
+
+        if (raise)
+        {
+            host_raise_irq(IO_IRQ_BANK0);
+        }
+
+        std::this_thread::sleep_for(EDGE_SAMPLE_INTERVAL);
+    }
+}
+
+void gpio_set_irq_enabled(uint gpio, uint32_t event_mask, bool enabled)
+{
+    static std::once_flag sampler_started;
+    auto &p = pin(gpio);
+
+    p.sampled_level = !p.is_output && p.source ? p.source() : p.level.load();
+    gpio_acknowledge_irq(gpio, event_mask);
+
+    if (enabled)
+    {
+        p.irq_mask |= event_mask;
+    }
+    else
+    {
+        p.irq_mask &= ~event_mask;
+    }
+
+    std::call_once(sampler_started, [] { std::thread(sample_edges).detach(); });
+}
+
+uint32_t gpio_get_irq_event_mask(uint gpio)
+{
+    return pin(gpio).irq_events;
+}
+
+void gpio_acknowledge_irq(uint gpio, uint32_t event_mask)
+{
+    pin(gpio).irq_events &= ~event_mask;
+}
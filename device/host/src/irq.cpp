@@ -0,0 +1,75 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Interrupts. Handlers run on the thread of the mock device that raised them.
+
+#include <array>
+#include <atomic>
+#include <mutex>
+
+#include "hardware/irq.h"
+#include "mock_hardware.h"
+#include "pico/stdlib.h"
+
+// PICO_MAX_SHARED_IRQ_HANDLERS of the SDK
+constexpr size_t MAX_SHARED_HANDLERS = 4;
+
+struct IrqLine
+{
+    std::array<irq_handler_t, MAX_SHARED_HANDLERS> handlers = {};
+    size_t handler_count = 0;
+    std::atomic<bool> enabled{false};
+};
+
+static std::mutex irq_mutex;
+static IrqLine irq_lines[32];
+
+void irq_add_shared_handler(uint num, irq_handler_t handler, uint8_t /* order_priority */)
+{
+    std::lock_guard<std::mutex> lock(irq_mutex);
+    auto &line = irq_lines[num];
+
+    hard_assert(line.handler_count < MAX_SHARED_HANDLERS);
+    line.handlers[line.handler_count++] = handler;
+}
+
+void irq_set_enabled(uint num, bool enabled)
+{
+    irq_lines[num].enabled = enabled;
+}
+
+// Runs the handlers one at a time, like a single core would
+void host_raise_irq(uint num)
+{
+    {
+        std::lock_guard<std::mutex> lock(irq_mutex);
+
+        if (!irq_lines[num].enabled)
+        {
+            return;
+        }
+
+        for (size_t i = 0; i < irq_lines[num].handler_count; i++)
+        {
+            irq_lines[num].handlers[i]();
+        }
+    }
+
+    // Returning from an interrupt wakes up __wfe()
+    __sev();
+}
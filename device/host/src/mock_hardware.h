@@ -0,0 +1,54 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Hooks for the mock devices attached to the host's GPIO pins and SPI bus, and
+// for cutting the power to the flash.
+
+#pragma once
+
+#include <functional>
+
+#include "hardware/gpio.h"
+#include "hardware/spi.h"
+
+// Called with the bytes the firmware sends. For reads `rx` is set, and the
+// device writes what it sends back there.
+typedef std::function<void(spi_inst_t *spi, const uint8_t *tx, uint8_t *rx, size_t len)> spi_device_fn;
+
+// Makes `gpio` read `source` while it is an input
+void host_gpio_drive(uint gpio, std::function<bool()> source);
+
+// Calls `watcher` whenever the firmware sets `gpio`
+void host_gpio_watch(uint gpio, std::function<void(bool)> watcher);
+
+// Level the firmware last set `gpio` to
+bool host_gpio_level(uint gpio);
+
+// Runs the handlers of interrupt `num` on the calling thread
+void host_raise_irq(uint num);
+
+// Passes every byte written to or read from any SPI bus to `device`, which has
+// to check its own chip select
+void host_spi_attach(spi_device_fn device);
+
+// Exit status of a program whose power was cut by host_flash_cut_after()
+constexpr int HOST_POWER_CUT_STATUS = 75;
+
+// Cuts the power, ending the program with HOST_POWER_CUT_STATUS, once `bytes`
+// more bytes of flash have been erased or programmed
+void host_flash_cut_after(size_t bytes);
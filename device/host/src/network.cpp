@@ -0,0 +1,469 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// lwIP's raw TCP API on top of non-blocking sockets. Like lwIP under the
+// threadsafe background cyw43 arch, callbacks run with the lwIP lock held, in
+// this case from async_context_poll().
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <mutex>
+
+#include "lwip/altcp_tcp.h"
+#include "lwip/dns.h"
+#include "pico/cyw43_arch.h"
+
+// TCP_MSS, TCP_WND and TCP_SND_BUF from lwipopts.h
+constexpr size_t SEGMENT_SIZE = 1460;
+constexpr size_t RECEIVE_WINDOW = 8 * SEGMENT_SIZE;
+constexpr size_t SEND_BUFFER_SIZE = 8 * SEGMENT_SIZE;
+// Connections come from a fixed pool, like lwIP's MEMP_NUM_TCP_PCB, so the
+// firmware's heap checks see no allocations from here
+constexpr size_t MAX_CONNECTIONS = 5;
+
+struct altcp_pcb
+{
+    bool in_use = false;
+    int fd = -1;
+    void *arg = nullptr;
+    altcp_recv_fn recv = nullptr;
+    altcp_err_fn err = nullptr;
+    altcp_connected_fn connected = nullptr;
+
+    bool connecting = false;
+    bool remote_closed = false;
+    // Bytes handed to the application that it hasn't taken with
+    // altcp_recved() yet. Nothing more is read while this fills the window.
+    size_t unacked = 0;
+    std::array<uint8_t, SEND_BUFFER_SIZE> send_buffer;
+    size_t send_len = 0;
+};
+
+cyw43_t cyw43_state;
+
+static async_context_t context;
+static std::recursive_mutex lwip_mutex;
+static std::array<altcp_pcb, MAX_CONNECTIONS> pcbs;
+// Set when callbacks ran. On the device they run from an interrupt, which
+// wakes up a pending wait for work like this does.
+static bool event_pending = false;
+
+async_context_t *cyw43_arch_async_context()
+{
+    return &context;
+}
+
+void cyw43_arch_lwip_begin()
+{
+    lwip_mutex.lock();
+}
+
+void cyw43_arch_lwip_end()
+{
+    lwip_mutex.unlock();
+}
+
+struct pbuf *pbuf_alloc_host(u16_t len)
+{
+    auto p = (struct pbuf *)malloc(sizeof(struct pbuf) + len);
+    hard_assert(p);
+
+    p->next = nullptr;
+    p->payload = p + 1;
+    p->tot_len = len;
+    p->len = len;
+
+    return p;
+}
+
+u8_t pbuf_free(struct pbuf *p)
+{
+    u8_t count = 0;
+
+    while (p)
+    {
+        auto next = p->next;
+        free(p);
+        p = next;
+        count++;
+    }
+
+    return count;
+}
+
+void pbuf_cat(struct pbuf *head, struct pbuf *tail)
+{
+    auto p = head;
+
+    for (; p->next; p = p->next)
+    {
+        p->tot_len += tail->tot_len;
+    }
+
+    p->tot_len += tail->tot_len;
+    p->next = tail;
+}
+
+err_t dns_gethostbyname(const char *hostname, ip_addr_t *addr, dns_found_callback /* found */,
+                        void * /* callback_arg */)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+
+    struct addrinfo *result;
+
+    if (getaddrinfo(hostname, nullptr, &hints, &result) != 0)
+    {
+        return ERR_ARG;
+    }
+
+    addr->addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+
+    return ERR_OK;
+}
+
+struct altcp_pcb *altcp_tcp_new_ip_type(u8_t /* ip_type */)
+{
+    for (auto &pcb : pcbs)
+    {
+        if (!pcb.in_use)
+        {
+            pcb = altcp_pcb();
+            pcb.in_use = true;
+            return &pcb;
+        }
+    }
+
+    return nullptr;
+}
+
+void altcp_arg(struct altcp_pcb *conn, void *arg)
+{
+    conn->arg = arg;
+}
+
+void altcp_recv(struct altcp_pcb *conn, altcp_recv_fn recv)
+{
+    conn->recv = recv;
+}
+
+void altcp_err(struct altcp_pcb *conn, altcp_err_fn err)
+{
+    conn->err = err;
+}
+
+err_t altcp_connect(struct altcp_pcb *conn, const ip_addr_t *ipaddr, u16_t port, altcp_connected_fn connected)
+{
+    conn->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+    if (conn->fd < 0)
+    {
+        return ERR_MEM;
+    }
+
+    int one = 1;
+    setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = ipaddr->addr;
+
+    if (connect(conn->fd, (struct sockaddr *)&address, sizeof(address)) != 0 && errno != EINPROGRESS)
+    {
+        return ERR_RTE;
+    }
+
+    // Connected is reported from async_context_poll(), like lwIP does
+    conn->connected = connected;
+    conn->connecting = true;
+
+    return ERR_OK;
+}
+
+err_t altcp_write(struct altcp_pcb *conn, const void *dataptr, u16_t len, u8_t /* apiflags */)
+{
+    if (len > altcp_sndbuf(conn))
+    {
+        return ERR_MEM;
+    }
+
+    memcpy(conn->send_buffer.data() + conn->send_len, dataptr, len);
+    conn->send_len += len;
+
+    return ERR_OK;
+}
+
+static bool flush(struct altcp_pcb *conn)
+{
+    if (conn->connecting || conn->send_len == 0)
+    {
+        return true;
+    }
+
+    auto sent = send(conn->fd, conn->send_buffer.data(), conn->send_len, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if (sent < 0)
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+
+    conn->send_len -= sent;
+    memmove(conn->send_buffer.data(), conn->send_buffer.data() + sent, conn->send_len);
+    return true;
+}
+
+err_t altcp_output(struct altcp_pcb *conn)
+{
+    return flush(conn) ? ERR_OK : ERR_CONN;
+}
+
+u16_t altcp_sndbuf(struct altcp_pcb *conn)
+{
+    return SEND_BUFFER_SIZE - conn->send_len;
+}
+
+void altcp_recved(struct altcp_pcb *conn, u16_t len)
+{
+    conn->unacked -= std::min<size_t>(len, conn->unacked);
+}
+
+static void free_pcb(struct altcp_pcb *conn)
+{
+    if (conn->fd >= 0)
+    {
+        close(conn->fd);
+    }
+
+    conn->in_use = false;
+}
+
+err_t altcp_close(struct altcp_pcb *conn)
+{
+    free_pcb(conn);
+    return ERR_OK;
+}
+
+void altcp_abort(struct altcp_pcb *conn)
+{
+    if (conn->fd >= 0)
+    {
+        // Reset the connection rather than closing it gracefully
+        struct linger linger = {1, 0};
+        setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &linger, sizeof(linger));
+    }
+
+    free_pcb(conn);
+}
+
+// Frees the connection and reports the error, which is how lwIP reports a
+// failed or reset connection
+static void fail(struct altcp_pcb *conn, err_t err)
+{
+    auto err_fn = conn->err;
+    auto arg = conn->arg;
+
+    free_pcb(conn);
+
+    if (err_fn)
+    {
+        err_fn(arg, err);
+        event_pending = true;
+    }
+}
+
+static bool is_alive(struct altcp_pcb *conn)
+{
+    return conn->in_use;
+}
+
+static void poll_connection(struct altcp_pcb *conn)
+{
+    if (conn->fd < 0)
+    {
+        return;
+    }
+
+    struct pollfd fd = {conn->fd, POLLIN | POLLOUT, 0};
+
+    if (poll(&fd, 1, 0) <= 0)
+    {
+        return;
+    }
+
+    if (conn->connecting)
+    {
+        if (!(fd.revents & (POLLOUT | POLLERR | POLLHUP)))
+        {
+            return;
+        }
+
+        int error = 0;
+        socklen_t len = sizeof(error);
+        getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &error, &len);
+
+        if (error != 0)
+        {
+            fail(conn, ERR_RST);
+            return;
+        }
+
+        conn->connecting = false;
+
+        if (conn->connected)
+        {
+            conn->connected(conn->arg, conn, ERR_OK);
+            event_pending = true;
+        }
+
+        if (!is_alive(conn))
+        {
+            return;
+        }
+    }
+
+    if (!flush(conn))
+    {
+        fail(conn, ERR_RST);
+        return;
+    }
+
+    // Hand data over a segment at a time, as long as the window allows
+    while (!conn->remote_closed && conn->unacked < RECEIVE_WINDOW)
+    {
+        auto len = std::min(SEGMENT_SIZE, RECEIVE_WINDOW - conn->unacked);
+        auto p = pbuf_alloc_host(len);
+        auto received = recv(conn->fd, p->payload, len, MSG_DONTWAIT);
+
+        if (received < 0)
+        {
+            pbuf_free(p);
+
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                fail(conn, ERR_RST);
+            }
+            return;
+        }
+
+        if (received == 0)
+        {
+            pbuf_free(p);
+            conn->remote_closed = true;
+
+            if (conn->recv)
+            {
+                conn->recv(conn->arg, conn, nullptr, ERR_OK);
+                event_pending = true;
+            }
+            return;
+        }
+
+        p->len = p->tot_len = received;
+        conn->unacked += received;
+
+        if (conn->recv)
+        {
+            conn->recv(conn->arg, conn, p, ERR_OK);
+            event_pending = true;
+        }
+        else
+        {
+            pbuf_free(p);
+        }
+
+        if (!is_alive(conn))
+        {
+            return;
+        }
+    }
+}
+
+void async_context_poll(async_context_t * /* context */)
+{
+    std::lock_guard<std::recursive_mutex> lock(lwip_mutex);
+
+    // Callbacks may open or close connections
+    for (auto &conn : pcbs)
+    {
+        if (is_alive(&conn))
+        {
+            poll_connection(&conn);
+        }
+    }
+}
+
+void async_context_wait_for_work_ms(async_context_t * /* context */, uint32_t ms)
+{
+    std::array<struct pollfd, MAX_CONNECTIONS> fds;
+    size_t fd_count = 0;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(lwip_mutex);
+
+        if (event_pending)
+        {
+            event_pending = false;
+            return;
+        }
+
+        for (auto &conn : pcbs)
+        {
+            if (!conn.in_use || conn.fd < 0)
+            {
+                continue;
+            }
+
+            short events = 0;
+
+            if (conn.connecting || conn.send_len > 0)
+            {
+                events |= POLLOUT;
+            }
+
+            if (!conn.connecting && !conn.remote_closed && conn.unacked < RECEIVE_WINDOW)
+            {
+                events |= POLLIN;
+            }
+
+            fds[fd_count++] = {conn.fd, events, 0};
+        }
+    }
+
+    if (fd_count == 0)
+    {
+        sleep_ms(ms);
+        return;
+    }
+
+    poll(fds.data(), fd_count, ms);
+}
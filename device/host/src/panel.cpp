@@ -0,0 +1,293 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Model of the Waveshare 13.3" (K) e-paper panels. It keeps the panel's RAM,
+// holds BUSY high for as long as a refresh would take, and writes what a
+// refresh shows to screen<id>.pbm in the working directory. The RAM can be
+// read back, and writes faster than the panel takes corrupt it.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <optional>
+#include <string>
+
+#include "image_sink.h"
+#include "mock_hardware.h"
+#include "pico/stdlib.h"
+#include "screens.h"
+
+constexpr uint32_t FULL_REFRESH_US = 3000 * 1000;
+constexpr uint32_t PARTIAL_REFRESH_US = 700 * 1000;
+constexpr uint32_t RESET_US = 10 * 1000;
+// Fastest SPI clock the panel receives RAM data correctly at. Real panels
+// vary with their wiring, so this is only a model.
+constexpr uint MAX_WRITE_BAUDRATE = 20 * 1000 * 1000;
+// Above that, every this many bytes has a bit flipped
+constexpr uint32_t CORRUPT_INTERVAL = 97;
+
+class Panel
+{
+  public:
+    Panel(int id, uint power, uint cs, uint dc, uint reset, uint busy) : id(id), cs(cs), dc(dc)
+    {
+        host_spi_attach(
+            [this](spi_inst_t *spi, const uint8_t *tx, uint8_t *rx, size_t len) { onSpi(spi, tx, rx, len); });
+        host_gpio_drive(busy, [this] { return time_us_64() < busy_until; });
+        host_gpio_watch(power, [this](bool on) {
+            if (!on)
+            {
+                // The RAM is lost without power
+                bw_ram.fill(0);
+                red_ram.fill(0);
+            }
+        });
+        host_gpio_watch(reset, [this](bool level) {
+            if (!level)
+            {
+                busy_until = time_us_64() + RESET_US;
+            }
+        });
+    }
+
+  private:
+    void onSpi(spi_inst_t *spi, const uint8_t *tx, uint8_t *rx, size_t len)
+    {
+        if (host_gpio_level(cs))
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        bool is_data = host_gpio_level(dc);
+        too_fast = spi_get_baudrate(spi) > MAX_WRITE_BAUDRATE;
+
+        for (size_t i = 0; i < len; i++)
+        {
+            if (is_data && rx)
+            {
+                rx[i] = onRead();
+            }
+            else if (is_data)
+            {
+                onData(tx[i]);
+            }
+            else
+            {
+                onCommand(tx[i]);
+            }
+        }
+    }
+
+    void onCommand(uint8_t value)
+    {
+        command = value;
+        param_count = 0;
+        read_count = 0;
+
+        if (command == 0x12)
+        {
+            busy_until = time_us_64() + RESET_US;
+        }
+        else if (command == 0x20)
+        {
+            activate();
+        }
+    }
+
+    void onData(uint8_t value)
+    {
+        if (command == 0x24)
+        {
+            writeRam(bw_ram, value);
+            return;
+        }
+        else if (command == 0x26)
+        {
+            writeRam(red_ram, value);
+            return;
+        }
+
+        if (param_count < params.size())
+        {
+            params[param_count++] = value;
+        }
+
+        auto param16 = [this](int i) { return (uint16_t)(params[i] | params[i + 1] << 8); };
+
+        if (command == 0x44 && param_count == 4)
+        {
+            x_start = param16(0);
+            x_end = param16(2);
+        }
+        else if (command == 0x45 && param_count == 4)
+        {
+            y_start = param16(0);
+            y_end = param16(2);
+        }
+        else if (command == 0x4E && param_count == 2)
+        {
+            x = param16(0);
+        }
+        else if (command == 0x4F && param_count == 2)
+        {
+            y = param16(0);
+        }
+        else if (command == 0x22 && param_count == 1)
+        {
+            update_mode = value;
+        }
+        else if (command == 0x41 && param_count == 1)
+        {
+            read_red_ram = value & 0x01;
+        }
+    }
+
+    // Command 0x27 reads the RAM picked with 0x41, after a dummy byte
+    uint8_t onRead()
+    {
+        if (command != 0x27 || read_count++ == 0)
+        {
+            return 0x00;
+        }
+
+        auto &ram = read_red_ram ? red_ram : bw_ram;
+        uint8_t value = 0;
+
+        if (x < IMAGE_WIDTH && y < IMAGE_HEIGHT)
+        {
+            value = ram[y * (IMAGE_WIDTH / 8) + x / 8];
+        }
+
+        advance();
+        return value;
+    }
+
+    void writeRam(std::array<uint8_t, IMAGE_SIZE> &ram, uint8_t value)
+    {
+        if (too_fast && ++write_count % CORRUPT_INTERVAL == 0)
+        {
+            value ^= 0x10;
+        }
+
+        if (x < IMAGE_WIDTH && y < IMAGE_HEIGHT)
+        {
+            ram[y * (IMAGE_WIDTH / 8) + x / 8] = value;
+        }
+
+        advance();
+    }
+
+    // Data entry mode 3: X increments, then Y
+    void advance()
+    {
+        x += 8;
+
+        if (x > x_end)
+        {
+            x = x_start;
+            y = y < y_end ? y + 1 : y_start;
+        }
+    }
+
+    void activate()
+    {
+        if (update_mode == 0xC0)
+        {
+            // Only enables the clock and analog
+            busy_until = time_us_64() + RESET_US;
+            return;
+        }
+
+        bool partial = update_mode == 0xCF;
+        refreshes++;
+
+        printf("[panel %d] %s refresh #%d\n", id, partial ? "Partial" : "Full", refreshes);
+        save();
+
+        // Started after saving, so the time that takes doesn't count
+        busy_until = time_us_64() + (partial ? PARTIAL_REFRESH_US : FULL_REFRESH_US);
+    }
+
+    // Writes the image as a PBM, where set bits are black
+    void save()
+    {
+        auto path = "screen" + std::to_string(id) + ".pbm";
+        auto temp_path = path + ".tmp";
+        auto file = fopen(temp_path.c_str(), "wb");
+
+        if (!file)
+        {
+            perror(temp_path.c_str());
+            return;
+        }
+
+        fprintf(file, "P4\n%d %d\n", IMAGE_WIDTH, IMAGE_HEIGHT);
+
+        for (auto byte : bw_ram)
+        {
+            fputc(~byte & 0xFF, file);
+        }
+
+        fclose(file);
+        rename(temp_path.c_str(), path.c_str());
+    }
+
+    const int id;
+    const uint cs;
+    const uint dc;
+
+    std::mutex mutex;
+    std::atomic<uint64_t> busy_until{0};
+    int refreshes = 0;
+
+    uint8_t command = 0;
+    std::array<uint8_t, 16> params;
+    size_t param_count = 0;
+    uint8_t update_mode = 0xF7;
+    bool read_red_ram = false;
+    size_t read_count = 0;
+    bool too_fast = false;
+    uint32_t write_count = 0;
+
+    uint16_t x_start = 0;
+    uint16_t x_end = IMAGE_WIDTH - 1;
+    uint16_t y_start = 0;
+    uint16_t y_end = IMAGE_HEIGHT - 1;
+    uint16_t x = 0;
+    uint16_t y = 0;
+
+    std::array<uint8_t, IMAGE_SIZE> bw_ram = {};
+    std::array<uint8_t, IMAGE_SIZE> red_ram = {};
+};
+
+// Wired up like the screens in core1_main(), from the same table
+static std::array<std::optional<Panel>, SCREEN_COUNT> panels;
+
+static bool panels_attached = [] {
+    for (int i = 0; i < SCREEN_COUNT; i++)
+    {
+        auto &pins = SCREENS[i];
+        panels[i].emplace(i + 1, pins.power, pins.cs, pins.dc, pins.reset, pins.busy);
+    }
+
+    return true;
+}();
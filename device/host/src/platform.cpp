@@ -0,0 +1,184 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Time, the second core and the rest of the board, on the host.
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "hardware/watchdog.h"
+#include "pico/multicore.h"
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+
+static const auto boot_time = std::chrono::steady_clock::now();
+
+// Bounds of the __uninitialized_ram() variables, from the linker
+extern "C" uint8_t __start_uninitialized_data[] __attribute__((weak));
+extern "C" uint8_t __stop_uninitialized_data[] __attribute__((weak));
+
+// Holds them from a watchdog reboot to the next run. The file is EHYMNBOARD_RAM,
+// or ram.bin in the working directory.
+static const char *ram_path()
+{
+    auto path = getenv("EHYMNBOARD_RAM");
+    return path ? path : "ram.bin";
+}
+
+static bool rebooted_by_watchdog = false;
+
+// Runs before the firmware's constructors, which may read the variables
+__attribute__((constructor(101))) static void restore_uninitialized_ram()
+{
+    auto file = fopen(ram_path(), "rb");
+
+    if (!file)
+    {
+        return;
+    }
+
+    size_t size = __stop_uninitialized_data - __start_uninitialized_data;
+    rebooted_by_watchdog = fread(__start_uninitialized_data, 1, size, file) == size;
+    fclose(file);
+
+    // Only a reboot keeps RAM, not starting again after a power cycle
+    remove(ram_path());
+}
+
+static thread_local uint core_num = 0;
+
+// Each core has an event flag of its own, which __sev() sets on both. With one
+// for both, a core could clear the event that was to wake up the other.
+static std::mutex event_mutex;
+static std::condition_variable event_signal;
+static bool event_pending[2] = {};
+
+bool stdio_init_all()
+{
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    return true;
+}
+
+uint64_t time_us_64()
+{
+    auto elapsed = std::chrono::steady_clock::now() - boot_time;
+    return std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+uint32_t time_us_32()
+{
+    return (uint32_t)time_us_64();
+}
+
+void sleep_us(uint64_t us)
+{
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+void sleep_ms(uint32_t ms)
+{
+    sleep_us(ms * 1000ull);
+}
+
+void sleep_until(absolute_time_t t)
+{
+    auto now = get_absolute_time();
+
+    if (t > now)
+    {
+        sleep_us(t - now);
+    }
+}
+
+void __sev()
+{
+    std::lock_guard<std::mutex> lock(event_mutex);
+    event_pending[0] = true;
+    event_pending[1] = true;
+    event_signal.notify_all();
+}
+
+void __wfe()
+{
+    std::unique_lock<std::mutex> lock(event_mutex);
+    event_signal.wait(lock, [] { return event_pending[core_num]; });
+    event_pending[core_num] = false;
+}
+
+bool best_effort_wfe_or_timeout(absolute_time_t timeout)
+{
+    std::unique_lock<std::mutex> lock(event_mutex);
+    auto now = get_absolute_time();
+
+    if (timeout > now)
+    {
+        event_signal.wait_for(lock, std::chrono::microseconds(timeout - now), [] { return event_pending[core_num]; });
+    }
+
+    event_pending[core_num] = false;
+    return time_reached(timeout);
+}
+
+uint get_core_num()
+{
+    return core_num;
+}
+
+void multicore_launch_core1(void (*entry)(void))
+{
+    std::thread([entry] {
+        core_num = 1;
+        entry();
+    }).detach();
+}
+
+void watchdog_enable(uint32_t /* delay_ms */, bool /* pause_on_debug */)
+{
+    printf("Watchdog reboot requested, exiting\n");
+    fflush(stdout);
+
+    auto file = fopen(ram_path(), "wb");
+
+    if (file)
+    {
+        fwrite(__start_uninitialized_data, 1, __stop_uninitialized_data - __start_uninitialized_data, file);
+        fclose(file);
+    }
+
+    _exit(EXIT_FAILURE);
+}
+
+bool watchdog_caused_reboot()
+{
+    return rebooted_by_watchdog;
+}
+
+void pico_get_unique_board_id_string(char *id_out, uint len)
+{
+    char hostname[64] = {};
+    gethostname(hostname, sizeof(hostname) - 1);
+
+    snprintf(id_out, len, "%016llX", (unsigned long long)std::hash<std::string>()(hostname));
+}
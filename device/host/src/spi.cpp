@@ -0,0 +1,361 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// SPI and DMA. Transfers take as long as they would at the
+// configured baud rate, and DMA transfers run on a thread per channel.
+
+#include <string.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "mock_hardware.h"
+
+struct spi_inst
+{
+    uint baudrate;
+    spi_hw_t hw;
+};
+
+static spi_inst spi_instances[2] = {};
+
+spi_inst_t *const spi0 = &spi_instances[0];
+spi_inst_t *const spi1 = &spi_instances[1];
+
+static std::vector<spi_device_fn> &spi_devices()
+{
+    static std::vector<spi_device_fn> devices;
+    return devices;
+}
+
+void host_spi_attach(spi_device_fn device)
+{
+    spi_devices().push_back(device);
+}
+
+uint spi_init(spi_inst_t *spi, uint baudrate)
+{
+    return spi_set_baudrate(spi, baudrate);
+}
+
+// Rounds down to what the prescaler and divider can make of the 125 MHz
+// peripheral clock, like the SDK does
+uint spi_set_baudrate(spi_inst_t *spi, uint baudrate)
+{
+    constexpr uint64_t FREQ_IN = 125 * 1000 * 1000;
+    uint prescale, postdiv;
+
+    for (prescale = 2; prescale <= 254; prescale += 2)
+    {
+        if (FREQ_IN < (prescale + 2) * 256 * (uint64_t)baudrate)
+        {
+            break;
+        }
+    }
+
+    for (postdiv = 256; postdiv > 1; --postdiv)
+    {
+        if (FREQ_IN / (prescale * (postdiv - 1)) > baudrate)
+        {
+            break;
+        }
+    }
+
+    spi->baudrate = FREQ_IN / (prescale * postdiv);
+    return spi->baudrate;
+}
+
+uint spi_get_baudrate(const spi_inst_t *spi)
+{
+    return spi->baudrate;
+}
+
+// Takes as long as the transfer would at the baud rate
+static void transfer(spi_inst_t *spi, const uint8_t *tx, uint8_t *rx, size_t len)
+{
+    hard_assert(spi->baudrate > 0);
+
+    for (auto &device : spi_devices())
+    {
+        device(spi, tx, rx, len);
+    }
+
+    std::this_thread::sleep_for(std::chrono::microseconds(len * 8 * 1000000ull / spi->baudrate));
+}
+
+int spi_write_blocking(spi_inst_t *spi, const uint8_t *src, size_t len)
+{
+    transfer(spi, src, nullptr, len);
+    return len;
+}
+
+// MISO reads as 0xFF unless a device drives it
+int spi_read_blocking(spi_inst_t *spi, uint8_t repeated_tx_data, uint8_t *dst, size_t len)
+{
+    uint8_t tx[64];
+    memset(tx, repeated_tx_data, sizeof(tx));
+    memset(dst, 0xFF, len);
+
+    for (size_t offset = 0; offset < len; offset += sizeof(tx))
+    {
+        transfer(spi, tx, dst + offset, len - offset < sizeof(tx) ? len - offset : sizeof(tx));
+    }
+
+    return len;
+}
+
+spi_hw_t *spi_get_hw(spi_inst_t *spi)
+{
+    return &spi->hw;
+}
+
+uint spi_get_dreq(spi_inst_t *spi, bool is_tx)
+{
+    return (spi == spi0 ? 16 : 18) + (is_tx ? 0 : 1);
+}
+
+struct DmaChannel
+{
+    bool claimed = false;
+    spi_inst_t *spi = nullptr;
+    std::atomic<bool> irq1_enabled{false};
+    std::atomic<bool> irq1_status{false};
+
+    std::mutex mutex;
+    std::condition_variable started;
+    const uint8_t *data = nullptr;
+    size_t len = 0;
+    bool busy = false;
+    bool worker_started = false;
+    bool sniff = false;
+
+    void run()
+    {
+        while (true)
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [this] { return busy; });
+            lock.unlock();
+
+            spi_write_blocking(spi, data, len);
+
+            lock.lock();
+            busy = false;
+            lock.unlock();
+
+            irq1_status = true;
+
+            if (irq1_enabled)
+            {
+                host_raise_irq(DMA_IRQ_1);
+            }
+        }
+    }
+};
+
+// Never destroyed, as their threads keep waiting on them after main() returns
+static auto &dma_channels = *new std::array<DmaChannel, NUM_DMA_CHANNELS>;
+
+// Works on the raw accumulator like the hardware, which reverses and inverts
+// the result only when it is read
+static struct
+{
+    int channel = -1;
+    uint mode = DMA_SNIFF_CTRL_CALC_VALUE_CRC32;
+    bool reverse = false;
+    bool invert = false;
+    uint32_t accumulator = 0;
+} sniffer;
+
+static uint8_t reverse_byte(uint8_t byte)
+{
+    uint8_t reversed = 0;
+
+    for (int bit = 0; bit < 8; bit++)
+    {
+        reversed |= ((byte >> bit) & 1) << (7 - bit);
+    }
+
+    return reversed;
+}
+
+static void sniff(uint channel, const uint8_t *data, size_t len)
+{
+    if ((int)channel != sniffer.channel)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        auto byte = sniffer.mode == DMA_SNIFF_CTRL_CALC_VALUE_CRC32R ? reverse_byte(data[i]) : data[i];
+        sniffer.accumulator ^= (uint32_t)byte << 24;
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            sniffer.accumulator = (sniffer.accumulator << 1) ^ (sniffer.accumulator & 0x80000000 ? 0x04C11DB7 : 0);
+        }
+    }
+}
+
+int dma_claim_unused_channel(bool required)
+{
+    for (int channel = 0; channel < NUM_DMA_CHANNELS; channel++)
+    {
+        if (!dma_channels[channel].claimed)
+        {
+            dma_channels[channel].claimed = true;
+            return channel;
+        }
+    }
+
+    hard_assert(!required);
+    return -1;
+}
+
+void dma_channel_configure(uint channel, const dma_channel_config *config, volatile void *write_addr,
+                           const volatile void *read_addr, uint transfer_count, bool trigger)
+{
+    auto &c = dma_channels[channel];
+    c.sniff = config->sniff;
+
+    for (auto spi : {spi0, spi1})
+    {
+        if (write_addr == &spi_get_hw(spi)->dr)
+        {
+            c.spi = spi;
+        }
+    }
+
+    if (!c.spi)
+    {
+        // Nothing receives the data, so it only goes past the sniffer
+        if (trigger && c.sniff)
+        {
+            sniff(channel, (const uint8_t *)read_addr, transfer_count);
+        }
+        return;
+    }
+
+    if (!c.worker_started)
+    {
+        std::thread([&c] { c.run(); }).detach();
+        c.worker_started = true;
+    }
+
+    if (trigger)
+    {
+        dma_channel_transfer_from_buffer_now(channel, read_addr, transfer_count);
+    }
+}
+
+void dma_channel_transfer_from_buffer_now(uint channel, const volatile void *read_addr, uint32_t transfer_count)
+{
+    auto &c = dma_channels[channel];
+    std::lock_guard<std::mutex> lock(c.mutex);
+
+    hard_assert(!c.busy);
+    c.data = (const uint8_t *)read_addr;
+    c.len = transfer_count;
+    c.busy = true;
+    c.started.notify_one();
+}
+
+void dma_channel_wait_for_finish_blocking(uint channel)
+{
+    auto &c = dma_channels[channel];
+
+    while (true)
+    {
+        std::lock_guard<std::mutex> lock(c.mutex);
+
+        if (!c.busy)
+        {
+            return;
+        }
+    }
+}
+
+void dma_sniffer_enable(uint channel, uint mode, bool force_channel_enable)
+{
+    hard_assert(mode == DMA_SNIFF_CTRL_CALC_VALUE_CRC32 || mode == DMA_SNIFF_CTRL_CALC_VALUE_CRC32R);
+
+    sniffer.channel = channel;
+    sniffer.mode = mode;
+
+    if (force_channel_enable)
+    {
+        dma_channels[channel].sniff = true;
+    }
+}
+
+void dma_sniffer_set_output_reverse_enabled(bool enable)
+{
+    sniffer.reverse = enable;
+}
+
+void dma_sniffer_set_output_invert_enabled(bool enable)
+{
+    sniffer.invert = enable;
+}
+
+void dma_sniffer_set_data_accumulator(uint32_t seed_value)
+{
+    sniffer.accumulator = seed_value;
+}
+
+uint32_t dma_sniffer_get_data_accumulator()
+{
+    uint32_t value = sniffer.accumulator;
+
+    if (sniffer.reverse)
+    {
+        uint32_t reversed = 0;
+
+        for (int byte = 0; byte < 4; byte++)
+        {
+            reversed |= (uint32_t)reverse_byte(value >> (8 * byte)) << (8 * (3 - byte));
+        }
+
+        value = reversed;
+    }
+
+    return sniffer.invert ? ~value : value;
+}
+
+void dma_channel_set_irq1_enabled(uint channel, bool enabled)
+{
+    dma_channels[channel].irq1_enabled = enabled;
+}
+
+bool dma_channel_get_irq1_status(uint channel)
+{
+    return dma_channels[channel].irq1_status;
+}
+
+void dma_channel_acknowledge_irq1(uint channel)
+{
+    dma_channels[channel].irq1_status = false;
+}
@@ -0,0 +1,150 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// How fast PackBitsDecoder decodes rendered screens, as written by
+// server/packbits_benchmark.py. Each screen is fed in chunks of a TCP segment,
+// like it arrives from the network, and checked against the raw frame.
+//
+//    bench_packbits <directory>
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "packbits.h"
+
+constexpr size_t SEGMENT_SIZE = 1460;
+constexpr int ROUNDS = 100;
+
+// Copies what it gets into a frame, as the display worker does
+class FrameSink : public ImageSink
+{
+  public:
+    void begin(const ImageRegion & /* region */) override
+    {
+        len = 0;
+    }
+
+    void write(const uint8_t *data, size_t len) override
+    {
+        if (this->len + len <= frame.size())
+        {
+            memcpy(frame.data() + this->len, data, len);
+        }
+
+        this->len += len;
+    }
+
+    std::array<uint8_t, IMAGE_SIZE> frame;
+    size_t len = 0;
+};
+
+static std::vector<uint8_t> read_file(const std::string &path)
+{
+    std::vector<uint8_t> data;
+    auto file = fopen(path.c_str(), "rb");
+
+    if (!file)
+    {
+        return data;
+    }
+
+    uint8_t buffer[4096];
+    size_t len;
+
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        data.insert(data.end(), buffer, buffer + len);
+    }
+
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 2)
+    {
+        printf("Usage: %s <directory written by server/packbits_benchmark.py>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static FrameSink sink;
+    PackBitsDecoder decoder(sink);
+    size_t total_encoded = 0;
+    size_t total_decoded = 0;
+    double total_us = 0;
+
+    printf("%-8s%10s%10s%12s%12s\n", "screen", "packbits", "decoded", "us/screen", "MB/s out");
+
+    for (int screen = 1;; screen++)
+    {
+        auto prefix = std::string(argv[1]) + "/" + std::to_string(screen);
+        auto encoded = read_file(prefix + ".packbits");
+        auto expected = read_file(prefix + ".frame");
+
+        if (encoded.empty())
+        {
+            break;
+        }
+
+        double best_us = 0;
+
+        for (int round = 0; round < ROUNDS; round++)
+        {
+            auto start = std::chrono::steady_clock::now();
+
+            decoder.begin(ImageRegion());
+
+            for (size_t offset = 0; offset < encoded.size(); offset += SEGMENT_SIZE)
+            {
+                decoder.write(encoded.data() + offset, std::min(SEGMENT_SIZE, encoded.size() - offset));
+            }
+
+            decoder.finish();
+
+            std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+            best_us = round == 0 ? elapsed.count() : std::min(best_us, elapsed.count());
+        }
+
+        if (sink.len != expected.size() || memcmp(sink.frame.data(), expected.data(), expected.size()) != 0)
+        {
+            printf("Screen %d doesn't decode to its frame\n", screen);
+            return EXIT_FAILURE;
+        }
+
+        printf("%-8d%10zu%10zu%12.1f%12.0f\n", screen, encoded.size(), sink.len, best_us, sink.len / best_us);
+
+        total_encoded += encoded.size();
+        total_decoded += sink.len;
+        total_us += best_us;
+    }
+
+    if (total_decoded == 0)
+    {
+        printf("No screens in %s\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    printf("%-8s%10zu%10zu%12.1f%12.0f\n", "all", total_encoded, total_decoded, total_us, total_decoded / total_us);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,300 @@
+# eHymnBoard device firmware
+# Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Runs the host firmware against a stand-in for the server and checks how it
+# polls:
+#
+# - A changed image is asked for within a second of the change.
+# - While nothing changes, the held manifest requests are the only requests,
+#   at least ten times fewer than when checking each screen on a timer.
+# - Without the manifest, each screen is checked and answered with 304, and
+#   the device still waits the minimum poll interval between checks.
+#
+# The firmware has to be built with the polling intervals scaled down, see
+# CMakeLists.txt. Run by ctest as:
+#
+#    python3 long_poll_test.py <firmware> <port> <wait_s> <min_poll_interval_ms>
+
+import os
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+SCREEN_IDS = [1, 2, 3]
+IMAGE_SIZE = 960 * 680 // 8
+
+# How long request rates are measured for
+IDLE_S = 10
+MAX_LATENCY_S = 1.0
+LATENCY_RUNS = 3
+
+
+class Server:
+    def __init__(self):
+        self.lock = threading.Condition()
+        self.versions = {screen: 1 for screen in SCREEN_IDS}
+        self.manifest_enabled = True
+        # [time, method, path, status] of each request, from when it arrived
+        self.requests = []
+
+    def etag(self, screen):
+        return f"{screen}-{self.versions[screen]}"
+
+    def image(self, screen):
+        return bytes([(screen * 16 + self.versions[screen]) & 0xFF]) * IMAGE_SIZE
+
+    def change(self, screen):
+        with self.lock:
+            self.versions[screen] += 1
+            self.lock.notify_all()
+
+    def set_manifest_enabled(self, enabled):
+        with self.lock:
+            self.manifest_enabled = enabled
+            self.lock.notify_all()
+
+    def log(self, method, path):
+        with self.lock:
+            request = [time.monotonic(), method, path, None]
+            self.requests.append(request)
+            self.lock.notify_all()
+            return request
+
+    def set_status(self, request, status):
+        with self.lock:
+            request[3] = status
+            self.lock.notify_all()
+
+    def wait_for_request(self, predicate, since, timeout_s):
+        """Waits for a request after `since` that matches, returning its time."""
+        deadline = time.monotonic() + timeout_s
+
+        with self.lock:
+            while True:
+                for request in self.requests:
+                    if request[0] >= since and predicate(request):
+                        return request[0]
+
+                left = deadline - time.monotonic()
+
+                if left <= 0:
+                    return None
+
+                self.lock.wait(left)
+
+    def requests_between(self, start, end):
+        with self.lock:
+            return [request for request in self.requests if start <= request[0] < end]
+
+
+server = Server()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def log_message(self, format, *args):
+        pass
+
+    def respond(self, status, body=b"", headers=()):
+        server.set_status(self.request_log, status)
+        self.send_response(status)
+
+        for name, value in headers:
+            self.send_header(name, value)
+
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def do_GET(self):
+        self.request_log = server.log(self.command, self.path)
+        url = urlparse(self.path)
+        parts = url.path.strip("/").split("/")
+
+        if parts == ["images", "manifest"]:
+            self.manifest(parse_qs(url.query))
+        elif len(parts) == 2 and parts[0] == "images" and parts[1].isdigit() and int(parts[1]) in SCREEN_IDS:
+            self.image(int(parts[1]))
+        else:
+            self.respond(404)
+
+    def do_POST(self):
+        self.request_log = server.log(self.command, self.path)
+        self.rfile.read(int(self.headers.get("Content-Length", 0)))
+        self.respond(204 if self.path == "/events" else 404)
+
+    def manifest(self, query):
+        wait_s = int(query.get("wait", ["0"])[0])
+        etags = query.get("etags", [""])[0].split(",")
+        deadline = time.monotonic() + wait_s
+
+        with server.lock:
+            while server.manifest_enabled:
+                current = [server.etag(screen) for screen in SCREEN_IDS]
+
+                if current != etags or time.monotonic() >= deadline:
+                    break
+
+                server.lock.wait(deadline - time.monotonic())
+
+            enabled = server.manifest_enabled
+            body = "".join(f"{screen} {server.etag(screen)}\n" for screen in SCREEN_IDS).encode()
+
+        if enabled:
+            self.respond(200, body, [("Content-Type", "text/plain")])
+        else:
+            self.respond(404)
+
+    def image(self, screen):
+        with server.lock:
+            etag = server.etag(screen)
+            image = server.image(screen)
+
+        if self.headers.get("If-None-Match") == etag:
+            self.respond(304, headers=[("ETag", etag)])
+        else:
+            self.respond(200, image, [("ETag", etag), ("Content-Type", "application/octet-stream")])
+
+
+def is_manifest(request):
+    return request[2].startswith("/images/manifest")
+
+
+def is_image(screen, status):
+    return lambda request: request[2].startswith(f"/images/{screen}?") and request[3] == status
+
+
+def fail(message, firmware, log_path):
+    print(f"FAILED: {message}")
+    firmware.kill()
+
+    with open(log_path) as log:
+        print("Last lines of the firmware's output:")
+        print("".join(log.readlines()[-30:]))
+
+    sys.exit(1)
+
+
+def main():
+    firmware_path, port, wait_s, min_poll_interval_ms = sys.argv[1:5]
+    min_poll_interval_s = int(min_poll_interval_ms) / 1000
+
+    http = ThreadingHTTPServer(("127.0.0.1", int(port)), Handler)
+    http.daemon_threads = True
+    threading.Thread(target=http.serve_forever, daemon=True).start()
+
+    with tempfile.TemporaryDirectory() as directory:
+        log_path = os.path.join(directory, "firmware.log")
+        env = dict(os.environ, EHYMNBOARD_FLASH=os.path.join(directory, "flash.bin"))
+
+        with open(log_path, "w") as log:
+            firmware = subprocess.Popen(
+                [os.path.abspath(firmware_path)], cwd=directory, env=env, stdout=log, stderr=subprocess.STDOUT
+            )
+
+        try:
+            # Boot: every screen is downloaded, then the device waits for changes
+            start = time.monotonic()
+
+            for screen in SCREEN_IDS:
+                if server.wait_for_request(is_image(screen, 200), start, 60) is None:
+                    fail(f"screen {screen} was never downloaded", firmware, log_path)
+
+            def wait_until_idle():
+                # The next manifest request, which the server holds
+                since = time.monotonic()
+
+                if server.wait_for_request(is_manifest, since, 30) is None:
+                    fail("the device stopped polling", firmware, log_path)
+
+                time.sleep(0.2)
+
+            wait_until_idle()
+
+            # Change-to-fetch latency, with the change made while the device
+            # waits for it
+            latencies = []
+
+            for run in range(LATENCY_RUNS):
+                screen = SCREEN_IDS[run % len(SCREEN_IDS)]
+                changed = time.monotonic()
+                server.change(screen)
+                fetched = server.wait_for_request(is_image(screen, 200), changed, 30)
+
+                if fetched is None:
+                    fail(f"the change to screen {screen} was never fetched", firmware, log_path)
+
+                latencies.append(fetched - changed)
+                wait_until_idle()
+
+            # Idle with the manifest
+            idle_start = time.monotonic()
+            time.sleep(IDLE_S)
+            idle = server.requests_between(idle_start, time.monotonic())
+            idle_rate = len(idle) / IDLE_S
+
+            # Idle without it, which checks each screen instead
+            server.set_manifest_enabled(False)
+            time.sleep(min_poll_interval_s * 2)
+            fallback_start = time.monotonic()
+            time.sleep(IDLE_S)
+            fallback = server.requests_between(fallback_start, time.monotonic())
+            fallback_rate = len(fallback) / IDLE_S
+
+            if firmware.poll() is not None:
+                fail(f"the firmware exited with status {firmware.returncode}", firmware, log_path)
+        finally:
+            firmware.kill()
+            firmware.wait()
+
+        # Checking each screen on a timer, as before the manifest
+        polling_rate = len(SCREEN_IDS) / min_poll_interval_s
+
+        print(f"Change-to-fetch latency: {', '.join(f'{latency * 1000:.0f} ms' for latency in latencies)}")
+        print(f"Idle requests with the manifest held {wait_s} s: {len(idle)} in {IDLE_S} s, {idle_rate:.2f}/s")
+        print(f"Without the manifest: {len(fallback)} in {IDLE_S} s, {fallback_rate:.2f}/s")
+        print(f"Polling each screen every {min_poll_interval_s:g} s: {polling_rate:.2f}/s")
+
+        if max(latencies) >= MAX_LATENCY_S:
+            fail(f"a change took {max(latencies) * 1000:.0f} ms to be fetched", firmware, log_path)
+
+        if not all(is_manifest(request) for request in idle):
+            fail("the device made other requests while nothing changed", firmware, log_path)
+
+        if idle_rate * 10 > polling_rate:
+            fail("the held manifest requests are not ten times fewer than polling", firmware, log_path)
+
+        images = [request for request in fallback if not is_manifest(request)]
+
+        if not images or any(request[3] != 304 for request in images):
+            fail("without the manifest, every screen should be checked and answered with 304", firmware, log_path)
+
+        # A manifest request and one for each screen per interval, with some
+        # slack for the time the checks themselves take
+        if fallback_rate > (len(SCREEN_IDS) + 1) / min_poll_interval_s * 1.2:
+            fail("without the manifest, the device checks faster than the minimum poll interval", firmware, log_path)
+
+        print("Long-poll checks passed")
+
+
+if __name__ == "__main__":
+    main()
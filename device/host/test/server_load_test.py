@@ -0,0 +1,218 @@
+# eHymnBoard device firmware
+# Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Runs a fleet of host firmware against the Flask app in server/, changes the
+# screens a few times and checks how long it takes until every device has
+# refreshed every screen. Prints those times and the fleet's telemetry as the
+# app collected it. Run by ctest as:
+#
+#    python3 server_load_test.py <firmware> <port> <server directory>
+
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+DEVICES = 8
+SCREEN_IDS = [1, 2, 3]
+CHANGES = 3
+
+# From a change on the server to every device having refreshed every screen:
+# noticing it within the app's 0.2 s manifest polling, the download, and a
+# full refresh of 3 s on the simulated panels, with margin for a busy host
+MAX_CHANGE_S = 10.0
+MAX_BOOT_S = 30.0
+
+# Lines shown on the screens after each change
+LINES = [
+    ["123", "456", "LSB 457", "vv. 1-4", "Psalm 23", ""],
+    ["Hymn 801", "vv. 1-4", "Offertory", "", "789", "Amen"],
+    ["", "", "", "", "", ""],
+]
+
+
+class Device:
+    def __init__(self, firmware, directory, index):
+        self.directory = os.path.join(directory, f"device{index}")
+        os.makedirs(self.directory)
+        self.log_path = os.path.join(self.directory, "firmware.log")
+
+        with open(self.log_path, "w") as log:
+            self.process = subprocess.Popen(
+                [firmware], cwd=self.directory, stdout=log, stderr=subprocess.STDOUT
+            )
+
+    def refreshes(self, screen):
+        """Number of times the screen has been refreshed."""
+        with open(self.log_path, errors="replace") as log:
+            return log.read().count(f"[{screen}] --> Refreshed")
+
+    def tail(self):
+        with open(self.log_path, errors="replace") as log:
+            return "".join(log.readlines()[-30:])
+
+
+def wait_for_refreshes(devices, counts, timeout_s):
+    """
+    Waits until every screen of every device has been refreshed more often
+    than in `counts`, returning when each device got there.
+    """
+    start = time.monotonic()
+    done = {}
+
+    while len(done) < len(devices) and time.monotonic() - start < timeout_s:
+        for i, device in enumerate(devices):
+            if i not in done and all(device.refreshes(s) > counts[i][s] for s in SCREEN_IDS):
+                done[i] = time.monotonic() - start
+
+        time.sleep(0.05)
+
+    return done
+
+
+def refresh_counts(devices):
+    return [{s: device.refreshes(s) for s in SCREEN_IDS} for device in devices]
+
+
+def fail(message, devices):
+    print(f"FAILED: {message}")
+
+    for i, device in enumerate(devices):
+        if device.process.poll() is not None:
+            print(f"Device {i} exited with status {device.process.returncode}:")
+            print(device.tail())
+
+    sys.exit(1)
+
+
+def post_lines(url, lines):
+    form = {"action": "apply"}
+    form.update({f"line{i + 1}": line for i, line in enumerate(lines)})
+    data = urllib.parse.urlencode(form).encode()
+
+    # The app redirects to its index page, which isn't needed here
+    class NoRedirect(urllib.request.HTTPRedirectHandler):
+        def redirect_request(self, *args):
+            return None
+
+    try:
+        urllib.request.build_opener(NoRedirect).open(f"{url}/images", data)
+    except urllib.error.HTTPError as error:
+        if error.code != 302:
+            raise
+
+
+def main():
+    firmware, port, server_dir = sys.argv[1:4]
+    firmware = os.path.abspath(firmware)
+    server_dir = os.path.abspath(server_dir)
+    url = f"http://127.0.0.1:{port}"
+
+    with tempfile.TemporaryDirectory() as directory:
+        # The app keeps its images in the working directory and loads its
+        # fonts from there
+        app_dir = os.path.join(directory, "server")
+        os.makedirs(app_dir)
+        os.symlink(os.path.join(server_dir, "fonts"), os.path.join(app_dir, "fonts"))
+
+        env = dict(os.environ, PYTHONPATH=server_dir, SCREEN_COUNT=str(len(SCREEN_IDS)))
+        env.pop("BASIC_AUTH_USERNAME", None)
+        env.pop("BASIC_AUTH_PASSWORD", None)
+
+        server = subprocess.Popen(
+            [
+                sys.executable,
+                "-c",
+                f"from app import app; app.run(host='127.0.0.1', port={port}, threaded=True)",
+            ],
+            cwd=app_dir,
+            env=env,
+            stdout=subprocess.DEVNULL,
+            stderr=subprocess.DEVNULL,
+        )
+
+        devices = []
+
+        try:
+            for _ in range(100):
+                try:
+                    urllib.request.urlopen(f"{url}/ok")
+                    break
+                except OSError:
+                    time.sleep(0.1)
+            else:
+                fail("the app didn't start", devices)
+
+            post_lines(url, LINES[-1])
+
+            counts = [{s: 0 for s in SCREEN_IDS}] * DEVICES
+            devices = [Device(firmware, directory, i) for i in range(DEVICES)]
+            boot = wait_for_refreshes(devices, counts, MAX_BOOT_S)
+
+            if len(boot) < DEVICES:
+                fail(f"{DEVICES - len(boot)} devices didn't show the first images", devices)
+
+            change_times = []
+
+            for lines in LINES[:CHANGES]:
+                # Let the devices go back to waiting for changes
+                time.sleep(1)
+                counts = refresh_counts(devices)
+                post_lines(url, lines)
+                done = wait_for_refreshes(devices, counts, MAX_CHANGE_S * 2)
+
+                if len(done) < DEVICES:
+                    fail(f"{DEVICES - len(done)} devices didn't show a change", devices)
+
+                change_times.extend(done.values())
+
+            # Reported along with the next manifest request
+            time.sleep(1)
+            telemetry = json.load(urllib.request.urlopen(f"{url}/telemetry"))
+        finally:
+            for device in devices:
+                device.process.kill()
+                device.process.wait()
+
+            server.kill()
+            server.wait()
+
+        print(f"{DEVICES} devices, {len(SCREEN_IDS)} screens each")
+        print(f"Boot to every screen shown: median {statistics.median(boot.values()):.2f} s, "
+              f"max {max(boot.values()):.2f} s")
+        print(f"Change to every screen refreshed, {CHANGES} changes: median {statistics.median(change_times):.2f} s, "
+              f"max {max(change_times):.2f} s")
+        print("Fleet telemetry, in ms:")
+
+        for name, phase in telemetry["fleet"].items():
+            print(f"  {name:6} count {phase['count']:4}  min {phase['min_ms']:5}  avg {phase['avg_ms']:5}  "
+                  f"max {phase['max_ms']:5}")
+
+        if max(change_times) > MAX_CHANGE_S:
+            fail(f"a change took {max(change_times):.2f} s to be shown, more than {MAX_CHANGE_S} s", devices)
+
+        print("Server load checks passed")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,161 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks that HttpClient reads chunked bodies, split at every byte, and goes
+// on to the next response on the same connection. Transfer codings it can't
+// decode fail the response.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include "check.h"
+#include "http_client.h"
+#include "scheduler.h"
+
+// Keeps the body and whether the response succeeded
+class Response : public HttpResponseHandler
+{
+  public:
+    void onStatus(int status_code) override
+    {
+        status = status_code;
+    }
+
+    void onBody(const uint8_t *data, size_t len) override
+    {
+        body.append((const char *)data, len);
+    }
+
+    void onComplete(bool success) override
+    {
+        completed++;
+        this->success = success;
+    }
+
+    int status = 0;
+    std::string body;
+    int completed = 0;
+    bool success = false;
+};
+
+// Responses to the requests, in order, all on one connection
+const char *const RESPONSES[] = {
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: chunked\r\n"
+    "\r\n"
+    "7\r\nHello, \r\n"
+    "d;name=value\r\nchunked world\r\n"
+    "0\r\n"
+    "Trailer: ignored\r\n"
+    "\r\n",
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Length: 5\r\n"
+    "\r\n"
+    "after",
+    "HTTP/1.1 200 OK\r\n"
+    "Transfer-Encoding: gzip, chunked\r\n"
+    "\r\n"
+    "5\r\nxxxxx\r\n"
+    "0\r\n\r\n",
+};
+
+// Answers each request once it has been received, a byte at a time so the
+// client sees the chunks split at every point
+void serve(int listener)
+{
+    int fd = accept(listener, nullptr, nullptr);
+    CHECK(fd >= 0);
+
+    std::string received;
+
+    for (auto response : RESPONSES)
+    {
+        while (received.find("\r\n\r\n") == std::string::npos)
+        {
+            char buf[1024];
+            auto len = read(fd, buf, sizeof(buf));
+            CHECK(len > 0);
+            received.append(buf, len);
+        }
+
+        received.erase(0, received.find("\r\n\r\n") + 4);
+
+        for (size_t i = 0; response[i]; i++)
+        {
+            CHECK(write(fd, &response[i], 1) == 1);
+        }
+    }
+
+    // The client has to close the connection after the response it couldn't
+    // read
+    char buf[1];
+    CHECK(read(fd, buf, sizeof(buf)) == 0);
+    close(fd);
+}
+
+Task<void> run_checks(u16_t port)
+{
+    static HttpClient client("127.0.0.1", port);
+
+    static Response chunked, after;
+    CHECK(client.get("/chunked", "", chunked));
+    CHECK(client.get("/after", "", after));
+    co_await client.run(5000);
+
+    CHECK(chunked.completed == 1 && chunked.success);
+    CHECK(chunked.status == 200);
+    CHECK(chunked.body == "Hello, chunked world");
+    CHECK(after.completed == 1 && after.success);
+    CHECK(after.body == "after");
+
+    // Goes on the same connection
+    static Response gzip;
+    CHECK(client.get("/gzip", "", gzip));
+    co_await client.run(5000);
+
+    CHECK(gzip.completed == 1 && !gzip.success);
+    CHECK(gzip.body.empty());
+
+    printf("HTTP client checks passed\n");
+    exit(EXIT_SUCCESS);
+}
+
+int main()
+{
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK(listener >= 0);
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t address_len = sizeof(address);
+    CHECK(bind(listener, (sockaddr *)&address, sizeof(address)) == 0);
+    CHECK(listen(listener, 1) == 0);
+    CHECK(getsockname(listener, (sockaddr *)&address, &address_len) == 0);
+
+    std::thread(serve, listener).detach();
+
+    scheduler.spawn(run_checks(ntohs(address.sin_port)));
+    scheduler.run();
+}
@@ -0,0 +1,120 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks PackBitsDecoder, feeding the same data in chunks of every size so
+// that runs and literals are split at every point.
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "check.h"
+#include "packbits.h"
+
+// Keeps everything written to it
+class BufferSink : public ImageSink
+{
+  public:
+    void begin(const ImageRegion & /* region */) override
+    {
+        data.clear();
+        began = true;
+    }
+
+    void write(const uint8_t *data, size_t len) override
+    {
+        this->data.insert(this->data.end(), data, data + len);
+    }
+
+    void end(bool complete) override
+    {
+        this->complete = complete;
+    }
+
+    std::vector<uint8_t> data;
+    bool began = false;
+    bool complete = false;
+};
+
+// Decodes `encoded` in chunks of `chunk_size`, returning whether it was whole
+static bool decode(const std::vector<uint8_t> &encoded, size_t chunk_size, BufferSink &sink)
+{
+    PackBitsDecoder decoder(sink);
+    decoder.begin(ImageRegion());
+
+    for (size_t offset = 0; offset < encoded.size(); offset += chunk_size)
+    {
+        decoder.write(encoded.data() + offset, std::min(chunk_size, encoded.size() - offset));
+    }
+
+    decoder.end(true);
+    return sink.complete;
+}
+
+static void check_decodes(const std::vector<uint8_t> &encoded, const std::vector<uint8_t> &expected)
+{
+    for (size_t chunk_size = 1; chunk_size <= encoded.size(); chunk_size++)
+    {
+        BufferSink sink;
+        CHECK(decode(encoded, chunk_size, sink));
+        CHECK(sink.data == expected);
+    }
+}
+
+int main()
+{
+    // The example from Apple's Technical Note TN1023
+    check_decodes({0xFE, 0xAA, 0x02, 0x80, 0x00, 0x2A, 0xFD, 0xAA, 0x03, 0x80, 0x00, 0x2A, 0x22, 0xF7, 0xAA},
+                  {0xAA, 0xAA, 0xAA, 0x80, 0x00, 0x2A, 0xAA, 0xAA, 0xAA, 0xAA, 0x80, 0x00, 0x2A, 0x22, 0xAA, 0xAA,
+                   0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA, 0xAA});
+
+    // -128 is skipped
+    check_decodes({0x80, 0x00, 0x11, 0x80, 0xFF, 0x22, 0x80}, {0x11, 0x22, 0x22});
+
+    // Runs and literals of the longest length, larger than the decoder's
+    // buffer together, as the server encodes a blank row
+    std::vector<uint8_t> encoded, expected;
+
+    for (int i = 0; i < 8; i++)
+    {
+        encoded.push_back(0x81);
+        encoded.push_back(i);
+        expected.insert(expected.end(), 128, i);
+
+        encoded.push_back(0x7F);
+
+        for (int j = 0; j < 128; j++)
+        {
+            encoded.push_back(i * 128 + j);
+            expected.push_back(i * 128 + j);
+        }
+    }
+
+    check_decodes(encoded, expected);
+
+    // Data that ends within a run or literal is incomplete
+    for (auto truncated : std::vector<std::vector<uint8_t>>{{0xFE}, {0x02, 0x01}, {0x00, 0x01, 0x7F}})
+    {
+        BufferSink sink;
+        CHECK(!decode(truncated, 1, sink));
+    }
+
+    printf("OK\n");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,90 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks SpiTuner against the panel model in src/panel.cpp, which corrupts RAM
+// writes above 20 MHz: calibration settles on the fastest rate below that, a
+// saved rate is kept only while it works, and falling back steps down one rate
+// at a time to 1 MHz.
+
+#include <array>
+#include <optional>
+
+#include "check.h"
+#include "screens.h"
+#include "spi_tuner.h"
+
+// The model's limit, and the rates around it that the divider makes exactly
+constexpr uint MAX_WRITE_BAUDRATE = 20 * 1000 * 1000;
+constexpr uint FASTEST_WORKING = 125 * 1000 * 1000 / 8;
+constexpr uint FIRST_FAILING = 125 * 1000 * 1000 / 6;
+
+int main()
+{
+    // Wired up like core1_main()
+    SPI spi(spi0, SPI_1MHZ, 2, 3, 4);
+    std::array<std::optional<Waveshare13K>, SCREEN_COUNT> displays;
+    Waveshare13K *screens[SCREEN_COUNT];
+
+    for (int i = 0; i < SCREEN_COUNT; i++)
+    {
+        auto &pins = SCREENS[i];
+        displays[i].emplace(spi, i + 1, pins.power, pins.cs, pins.dc, pins.reset, pins.busy);
+        screens[i] = &*displays[i];
+    }
+
+    SpiTuner tuner(spi, screens, SCREEN_COUNT);
+
+    // Without a saved rate, calibration goes up to the first rate that fails
+    auto baudrate = tuner.tune(0);
+    printf("Calibrated to %u Hz\n", baudrate);
+    CHECK(baudrate <= MAX_WRITE_BAUDRATE);
+    CHECK(baudrate == FASTEST_WORKING);
+    CHECK(spi.getBaudrate() == baudrate);
+    CHECK(tuner.getBaudrate() == baudrate);
+
+    // A saved rate that works is kept, even if it isn't the fastest
+    CHECK(tuner.tune(SPI_1MHZ) == SPI_1MHZ);
+    CHECK(tuner.tune(FASTEST_WORKING) == FASTEST_WORKING);
+
+    // One that no longer works is calibrated again
+    CHECK(tuner.tune(FIRST_FAILING) == FASTEST_WORKING);
+    CHECK(tuner.tune(125 * 1000 * 1000 / 4) == FASTEST_WORKING);
+    CHECK(spi.getBaudrate() == FASTEST_WORKING);
+
+    // Falling back steps down through every slower rate, then stays at 1 MHz
+    uint previous = tuner.getBaudrate();
+    int steps = 0;
+
+    while (previous > SPI_1MHZ)
+    {
+        auto slower = tuner.fallBack();
+        printf("Fell back to %u Hz\n", slower);
+        CHECK(slower < previous);
+        CHECK(spi.getBaudrate() == slower);
+        previous = slower;
+        steps++;
+    }
+
+    // The slowest is 1 MHz as near as the divider makes it
+    CHECK(steps == 6);
+    CHECK(previous > SPI_1MHZ * 99 / 100);
+    CHECK(tuner.fallBack() == previous);
+    CHECK(tuner.getBaudrate() == previous);
+
+    printf("SPI tuner checks passed\n");
+}
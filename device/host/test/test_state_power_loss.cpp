@@ -0,0 +1,202 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Cuts the power to the flash part way through saving the state, with the
+// save landing on each page of the state log in turn, and checks that the
+// state saved before it is the one found after the reboot. Each boot is a
+// program of its own, which this test starts again with a mode:
+//
+//    test_state_power_loss save <page> <cut>   Saves until the next save lands
+//                                              on <page>, prints the write
+//                                              count, and cuts that save off
+//                                              after <cut> bytes
+//    test_state_power_loss check <count>       Checks the saved state
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "check.h"
+#include "mock_hardware.h"
+#include "state.h"
+
+constexpr uint32_t STATE_LOG_PAGES = STATE_LOG_SIZE / FLASH_PAGE_SIZE;
+constexpr uint32_t PAGES_PER_SECTOR = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
+
+// A record is a header of four words and the state. Cuts beyond it leave the
+// record whole, as the rest of the page stays erased.
+constexpr size_t RECORD_SIZE = 4 * sizeof(uint32_t) + sizeof(SavedState);
+
+// Where a save is cut off, in bytes erased or programmed: in the header, in
+// the state and at its last byte, and for saves that start a sector, also
+// while the sector is erased
+const size_t PROGRAM_CUTS[] = {0, 1, 4, 8, 12, 16, RECORD_SIZE / 2, RECORD_SIZE - 1};
+const size_t ERASE_CUTS[] = {0, 1, FLASH_SECTOR_SIZE / 2, FLASH_SECTOR_SIZE - 1, FLASH_SECTOR_SIZE,
+                             FLASH_SECTOR_SIZE + 16, FLASH_SECTOR_SIZE + RECORD_SIZE - 1};
+
+static uint32_t page_of(const SavedState *state)
+{
+    return ((uintptr_t)state - XIP_BASE - STATE_LOG_OFFSET) / FLASH_PAGE_SIZE;
+}
+
+static bool is_page_erased(uint32_t page)
+{
+    auto bytes = (const uint8_t *)(XIP_BASE + STATE_LOG_OFFSET + page * FLASH_PAGE_SIZE);
+
+    for (size_t i = 0; i < FLASH_PAGE_SIZE; i++)
+    {
+        if (bytes[i] != 0xFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Page the next save lands on, skipping pages left behind by a save that
+// was cut off like SavedState::save() does
+static uint32_t next_save_page()
+{
+    auto page = (page_of(flash_saved_state) + 1) % STATE_LOG_PAGES;
+
+    while (page % PAGES_PER_SECTOR != 0 && !is_page_erased(page))
+    {
+        page = (page + 1) % STATE_LOG_PAGES;
+    }
+
+    return page;
+}
+
+static int save(uint32_t page, size_t cut)
+{
+    if (!flash_saved_state->is_valid())
+    {
+        SavedState::initial().save();
+    }
+
+    while (next_save_page() != page)
+    {
+        SavedState(flash_saved_state).save();
+    }
+
+    printf("%d\n", flash_saved_state->write_count);
+    fflush(stdout);
+
+    host_flash_cut_after(cut);
+    SavedState(flash_saved_state).save();
+
+    printf("The save wasn't cut off\n");
+    return EXIT_FAILURE;
+}
+
+static int check(int write_count)
+{
+    CHECK(flash_saved_state->is_valid());
+    CHECK(!flash_saved_state->is_wrong_version() && !flash_saved_state->is_old_version());
+    CHECK(page_of(flash_saved_state) < STATE_LOG_PAGES);
+    CHECK(flash_saved_state->write_count == write_count);
+    return EXIT_SUCCESS;
+}
+
+// Runs this program in another mode, returning its exit status and the last
+// line it printed
+static int run(const std::string &args, std::string &output)
+{
+    char path[4096];
+    auto len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    CHECK(len > 0);
+    path[len] = '\0';
+
+    auto command = std::string(path) + " " + args;
+    auto pipe = popen(command.c_str(), "r");
+    CHECK(pipe);
+
+    char line[256];
+
+    while (fgets(line, sizeof(line), pipe))
+    {
+        output = line;
+    }
+
+    int status = pclose(pipe);
+    CHECK(WIFEXITED(status));
+    return WEXITSTATUS(status);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc == 4 && strcmp(argv[1], "save") == 0)
+    {
+        return save(atoi(argv[2]), atoi(argv[3]));
+    }
+
+    if (argc == 3 && strcmp(argv[1], "check") == 0)
+    {
+        return check(atoi(argv[2]));
+    }
+
+    // Start from an empty log
+    flash_range_erase(STATE_LOG_OFFSET, STATE_LOG_SIZE);
+
+    int cuts = 0;
+
+    // The second time around, every sector is erased over older records
+    for (int lap = 0; lap < 2; lap++)
+    {
+        for (uint32_t page = 0; page < STATE_LOG_PAGES; page++)
+        {
+            size_t cut;
+
+            if (page % PAGES_PER_SECTOR == 0)
+            {
+                cut = ERASE_CUTS[(lap * STATE_LOG_SECTORS + page / PAGES_PER_SECTOR) % std::size(ERASE_CUTS)];
+            }
+            else
+            {
+                cut = PROGRAM_CUTS[(lap * STATE_LOG_PAGES + page) % std::size(PROGRAM_CUTS)];
+            }
+
+            std::string saved, output;
+            int status = run("save " + std::to_string(page) + " " + std::to_string(cut), saved);
+
+            if (status != HOST_POWER_CUT_STATUS)
+            {
+                printf("Saving at page %u failed with status %d: %s", page, status, saved.c_str());
+                return EXIT_FAILURE;
+            }
+
+            if (run("check " + std::to_string(atoi(saved.c_str())), output) != EXIT_SUCCESS)
+            {
+                printf("Cutting the save at page %u after %zu bytes lost state %d: %s", page, cut,
+                       atoi(saved.c_str()), output.c_str());
+                return EXIT_FAILURE;
+            }
+
+            cuts++;
+        }
+    }
+
+    printf("The newest state survived %d cut-off saves\n", cuts);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,244 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Checks what Waveshare13K sends over the bus. Images are streamed with DMA,
+// which has to produce the same bytes as the blocking writes, keep chip select
+// low and data/command steady for the whole transfer, and keep other displays
+// on the bus off it until the transfer is done.
+
+#include <string.h>
+
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "check.h"
+#include "mock_hardware.h"
+#include "waveshare.h"
+
+// Pins of the two displays, besides the bus
+constexpr uint POWER_A = 9, CS_A = 5, DC_A = 6, RESET_A = 7, BUSY_A = 8;
+constexpr uint POWER_B = 14, CS_B = 10, DC_B = 11, RESET_B = 12, BUSY_B = 13;
+
+// Bytes one display received while its chip select was low
+struct Transaction
+{
+    bool is_data;
+    std::vector<uint8_t> bytes;
+
+    bool operator==(const Transaction &other) const = default;
+};
+
+// Records the bus, checking that only one display is selected at a time and
+// that data/command doesn't change during a transaction
+class BusRecorder
+{
+  public:
+    BusRecorder()
+    {
+        host_spi_attach([this](spi_inst_t *, const uint8_t *tx, uint8_t *, size_t len) { onSpi(tx, len); });
+
+        for (int i = 0; i < 2; i++)
+        {
+            host_gpio_watch(cs[i], [this, i](bool level) { onChipSelect(i, level); });
+            host_gpio_watch(dc[i], [this, i](bool) { onDataCommand(i); });
+        }
+    }
+
+    // Transactions of display `i` since the last call
+    std::vector<Transaction> take(int i)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return std::exchange(transactions[i], {});
+    }
+
+    // Transactions of display `i` so far, without taking them
+    size_t count(int i)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return transactions[i].size();
+    }
+
+    int errors()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return error_count;
+    }
+
+  private:
+    void onChipSelect(int i, bool level)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (!level)
+        {
+            if (selected >= 0)
+            {
+                printf("Display %d selected while display %d is\n", i, selected);
+                error_count++;
+            }
+
+            selected = i;
+            transactions[i].push_back({host_gpio_level(dc[i]), {}});
+        }
+        else if (selected == i)
+        {
+            selected = -1;
+        }
+    }
+
+    void onDataCommand(int i)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (selected == i && !transactions[i].back().bytes.empty())
+        {
+            printf("Data/command of display %d changed during a transaction\n", i);
+            error_count++;
+        }
+        else if (selected == i)
+        {
+            transactions[i].back().is_data = host_gpio_level(dc[i]);
+        }
+    }
+
+    void onSpi(const uint8_t *tx, size_t len)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (selected < 0)
+        {
+            printf("%zu bytes sent with no display selected\n", len);
+            error_count++;
+            return;
+        }
+
+        auto &bytes = transactions[selected].back().bytes;
+        bytes.insert(bytes.end(), tx, tx + len);
+    }
+
+    const uint cs[2] = {CS_A, CS_B};
+    const uint dc[2] = {DC_A, DC_B};
+
+    std::mutex mutex;
+    int selected = -1;
+    std::vector<Transaction> transactions[2];
+    int error_count = 0;
+};
+
+static BusRecorder recorder;
+
+static std::vector<Transaction> command(std::initializer_list<uint8_t> command_and_data)
+{
+    std::vector<Transaction> transactions = {{false, {*command_and_data.begin()}}};
+
+    for (auto it = command_and_data.begin() + 1; it != command_and_data.end(); it++)
+    {
+        transactions.push_back({true, {*it}});
+    }
+
+    return transactions;
+}
+
+static void append(std::vector<Transaction> &to, const std::vector<Transaction> &transactions)
+{
+    to.insert(to.end(), transactions.begin(), transactions.end());
+}
+
+int main()
+{
+    SPI spi(spi0, 8 * SPI_1MHZ, 2, 3, 4);
+    Waveshare13K a(spi, 1, POWER_A, CS_A, DC_A, RESET_A, BUSY_A);
+    Waveshare13K b(spi, 2, POWER_B, CS_B, DC_B, RESET_B, BUSY_B);
+
+    static std::array<uint8_t, IMAGE_SIZE> frame;
+
+    for (size_t i = 0; i < frame.size(); i++)
+    {
+        frame[i] = i * 7 + i / 120;
+    }
+
+    // A full image streamed in rows sends the same as writing each chunk to
+    // both RAMs with the blocking writes
+    constexpr size_t CHUNK_SIZE = 10 * Waveshare13K::ROW_BYTES;
+
+    a.begin(ImageRegion());
+    b.init();
+    recorder.take(0);
+    recorder.take(1);
+
+    for (size_t offset = 0; offset < IMAGE_SIZE; offset += CHUNK_SIZE)
+    {
+        a.write(frame.data() + offset, CHUNK_SIZE);
+        CHECK(a.isTransferring());
+
+        // Returns once the new RAM's half is started, the rest is chained
+        // from the DMA interrupt
+        if (offset == 0)
+        {
+            CHECK(recorder.count(0) <= 8);
+        }
+
+        uint16_t y = offset / Waveshare13K::ROW_BYTES;
+        b.writeRam(Waveshare13K::NEW_RAM, y, frame.data() + offset, CHUNK_SIZE);
+        b.writeRam(Waveshare13K::PREVIOUS_RAM, y, frame.data() + offset, CHUNK_SIZE);
+    }
+
+    a.waitForTransfer();
+
+    auto streamed = recorder.take(0);
+    auto blocking = recorder.take(1);
+    CHECK(streamed.size() == IMAGE_SIZE / CHUNK_SIZE * 16);
+    CHECK(streamed == blocking);
+
+    // Displaying a frame sends both RAMs, then starts the refresh
+    a.display(frame);
+
+    std::vector<Transaction> expected;
+    std::vector<uint8_t> frame_bytes(frame.begin(), frame.end());
+    append(expected, {{false, {0x24}}, {true, frame_bytes}, {false, {0x26}}, {true, frame_bytes}});
+    append(expected, command({0x22, 0xF7}));
+    append(expected, command({0x20}));
+    CHECK(recorder.take(0) == expected);
+
+    // A partial image goes to the new RAM within its region, in one
+    // transaction per write
+    ImageRegion region = {64, 100, 128, 20};
+    a.begin(region);
+    recorder.take(0);
+
+    std::vector<uint8_t> partial(region.size());
+    memcpy(partial.data(), frame.data(), partial.size());
+    a.write(partial.data(), partial.size() / 2);
+    a.write(partial.data() + partial.size() / 2, partial.size() - partial.size() / 2);
+
+    // Whatever comes next waits for the transfer
+    a.startRefresh();
+
+    expected = {
+        {true, std::vector<uint8_t>(partial.begin(), partial.begin() + partial.size() / 2)},
+        {true, std::vector<uint8_t>(partial.begin() + partial.size() / 2, partial.end())},
+    };
+    append(expected, command({0x22, 0xCF}));
+    append(expected, command({0x20}));
+    CHECK(recorder.take(0) == expected);
+
+    CHECK(recorder.errors() == 0);
+    printf("OK\n");
+    return EXIT_SUCCESS;
+}
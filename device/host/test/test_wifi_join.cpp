@@ -0,0 +1,281 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Times setup_wifi() from the device's wifi.cpp on a simulated Wi-Fi chip, for
+// a boot that has to scan for the network, as every boot did before the last
+// network was saved, and for one that joins the saved network directly. Also
+// checks the fallback to the scan once the access point has moved to another
+// channel, and that monitor_wifi() rejoins with the auth mode it joined with.
+//
+// The chip takes as long as the constants below say, which are typical for
+// the CYW43439 and a home access point rather than measured on one. The times
+// printed are those of the firmware's own code paths on top of that.
+
+#include <string.h>
+
+#include <string>
+
+#include "check.h"
+#include "pico/cyw43_arch.h"
+#include "scheduler.h"
+#include "secrets.h"
+#include "state.h"
+#include "wifi.h"
+
+// A full scan dwells on each of the 13 channels of 2.4 GHz, probing actively
+// and waiting for beacons on those that can't be probed
+constexpr uint32_t CHANNELS = 13;
+constexpr uint32_t SCAN_CHANNEL_MS = 120;
+// Joining without a channel first looks for the BSSID on each channel, with
+// a shorter active probe
+constexpr uint32_t JOIN_SCAN_CHANNEL_MS = 40;
+// Authentication, association and the WPA2 handshake
+constexpr uint32_t ASSOCIATE_MS = 250;
+constexpr uint32_t DHCP_MS = 600;
+// Joining fails when the access point is not on the channel asked for
+constexpr uint32_t NO_NETWORK_MS = JOIN_SCAN_CHANNEL_MS;
+
+// The access point of the network in the secrets, and another one nearby
+struct AccessPoint
+{
+    std::string ssid;
+    uint8_t bssid[6];
+    uint16_t channel;
+    int16_t rssi;
+};
+
+static AccessPoint access_point = {WIFI_SSIDS.begin()->first, {0x02, 0x00, 0x00, 0x00, 0x00, 0x01}, 6, -55};
+static const AccessPoint neighbor = {"Neighbor", {0x02, 0x00, 0x00, 0x00, 0x00, 0x02}, 1, -80};
+
+static absolute_time_t scan_done = 0;
+static void *scan_env = nullptr;
+static int (*scan_callback)(void *, const cyw43_ev_scan_result_t *) = nullptr;
+
+// Result of the current join, once `join_done` is reached
+static int join_status = CYW43_LINK_DOWN;
+static absolute_time_t join_done = 0;
+static int scans = 0;
+static uint32_t join_auth = 0;
+
+int cyw43_arch_init()
+{
+    return 0;
+}
+
+void cyw43_arch_enable_sta_mode()
+{
+}
+
+void cyw43_arch_poll()
+{
+}
+
+void cyw43_arch_wait_for_work_until(absolute_time_t until)
+{
+    auto next = make_timeout_time_ms(1);
+    sleep_until(next < until ? next : until);
+}
+
+int cyw43_wifi_scan(cyw43_t * /* self */, cyw43_wifi_scan_options_t * /* opts */, void *env,
+                    int (*result_cb)(void *, const cyw43_ev_scan_result_t *))
+{
+    scan_done = make_timeout_time_ms(CHANNELS * SCAN_CHANNEL_MS);
+    scan_env = env;
+    scan_callback = result_cb;
+    scans++;
+    return 0;
+}
+
+static void report(const AccessPoint &ap)
+{
+    cyw43_ev_scan_result_t result = {};
+    memcpy(result.bssid, ap.bssid, sizeof(result.bssid));
+    result.ssid_len = ap.ssid.size();
+    memcpy(result.ssid, ap.ssid.data(), ap.ssid.size());
+    result.channel = ap.channel;
+    result.rssi = ap.rssi;
+
+    scan_callback(scan_env, &result);
+}
+
+bool cyw43_wifi_scan_active(cyw43_t * /* self */)
+{
+    if (!scan_callback || !time_reached(scan_done))
+    {
+        return scan_callback != nullptr;
+    }
+
+    report(neighbor);
+    report(access_point);
+    scan_callback = nullptr;
+    return false;
+}
+
+int cyw43_wifi_join(cyw43_t * /* self */, size_t ssid_len, const uint8_t *ssid, size_t /* key_len */,
+                    const uint8_t * /* key */, uint32_t auth_type, const uint8_t *bssid, uint32_t channel)
+{
+    join_auth = auth_type;
+
+    bool found = std::string((const char *)ssid, ssid_len) == access_point.ssid &&
+                 (!bssid || memcmp(bssid, access_point.bssid, sizeof(access_point.bssid)) == 0) &&
+                 (channel == CYW43_CHANNEL_NONE || channel == access_point.channel);
+
+    if (!found)
+    {
+        join_status = CYW43_LINK_NONET;
+        join_done = make_timeout_time_ms(channel == CYW43_CHANNEL_NONE ? CHANNELS * JOIN_SCAN_CHANNEL_MS
+                                                                       : NO_NETWORK_MS);
+        return 0;
+    }
+
+    auto find_ms = channel == CYW43_CHANNEL_NONE ? CHANNELS * JOIN_SCAN_CHANNEL_MS : JOIN_SCAN_CHANNEL_MS;
+    join_status = CYW43_LINK_UP;
+    join_done = make_timeout_time_ms(find_ms + ASSOCIATE_MS + DHCP_MS);
+    return 0;
+}
+
+int cyw43_wifi_leave(cyw43_t * /* self */, int /* itf */)
+{
+    join_status = CYW43_LINK_DOWN;
+    join_done = 0;
+    return 0;
+}
+
+int cyw43_tcpip_link_status(cyw43_t * /* self */, int /* itf */)
+{
+    if (join_status == CYW43_LINK_DOWN || time_reached(join_done))
+    {
+        return join_status;
+    }
+
+    return CYW43_LINK_JOIN;
+}
+
+// Like the Pico SDK's, which joins without a channel
+int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth)
+{
+    return cyw43_wifi_join(&cyw43_state, strlen(ssid), (const uint8_t *)ssid, strlen(pw), (const uint8_t *)pw, auth,
+                           nullptr, CYW43_CHANNEL_NONE);
+}
+
+int cyw43_arch_wifi_connect_bssid_timeout_ms(const char *ssid, const uint8_t *bssid, const char *pw, uint32_t auth,
+                                             uint32_t timeout)
+{
+    cyw43_wifi_join(&cyw43_state, strlen(ssid), (const uint8_t *)ssid, strlen(pw), (const uint8_t *)pw, auth, bssid,
+                    CYW43_CHANNEL_NONE);
+    auto deadline = make_timeout_time_ms(timeout);
+    int status;
+
+    while ((status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA)) != CYW43_LINK_UP)
+    {
+        if (status < 0)
+        {
+            return PICO_ERROR_CONNECT_FAILED;
+        }
+
+        if (time_reached(deadline))
+        {
+            return PICO_ERROR_TIMEOUT;
+        }
+
+        cyw43_arch_wait_for_work_until(deadline);
+    }
+
+    return PICO_OK;
+}
+
+// Boots the Wi-Fi as main() does, returning how long it took in ms and the
+// number of scans it ran
+static uint32_t boot(int &boot_scans)
+{
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    scans = 0;
+
+    auto start = time_us_32();
+    setup_wifi();
+    auto elapsed_ms = (time_us_32() - start) / 1000;
+
+    CHECK(cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP);
+    boot_scans = scans;
+    return elapsed_ms;
+}
+
+// Drops the link once monitor_wifi() is running and waits for it to rejoin
+static Task<void> check_rejoin()
+{
+    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    join_auth = 0;
+
+    while (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) != CYW43_LINK_UP)
+    {
+        co_await scheduler.sleep(100);
+    }
+
+    CHECK(join_auth == CYW43_AUTH_WPA2_MIXED_PSK);
+
+    printf("Wi-Fi join checks passed\n");
+    exit(EXIT_SUCCESS);
+}
+
+int main()
+{
+    // Start without a saved network, as after the update
+    SavedState state(flash_saved_state);
+    state.wifi_network = {};
+    state.save();
+
+    int scan_boot_scans, direct_boot_scans, moved_boot_scans;
+    auto scan_boot_ms = boot(scan_boot_scans);
+
+    // The network joined is saved, with its channel
+    CHECK(flash_saved_state->has_wifi_network());
+    CHECK(flash_saved_state->wifi_network.channel == access_point.channel);
+
+    auto writes = flash_saved_state->write_count;
+    auto direct_boot_ms = boot(direct_boot_scans);
+
+    // Nothing changed, so nothing is saved
+    CHECK(flash_saved_state->write_count == writes);
+
+    access_point.channel = 11;
+    auto moved_boot_ms = boot(moved_boot_scans);
+    CHECK(flash_saved_state->wifi_network.channel == access_point.channel);
+
+    printf("Boot to Wi-Fi connected, scanning first:        %5u ms, %d scan\n", scan_boot_ms, scan_boot_scans);
+    printf("Boot to Wi-Fi connected, joining the saved AP:  %5u ms, %d scans\n", direct_boot_ms, direct_boot_scans);
+    printf("Boot after the AP moved to another channel:     %5u ms, %d scan\n", moved_boot_ms, moved_boot_scans);
+
+    CHECK(scan_boot_scans == 1);
+    CHECK(direct_boot_scans == 0);
+    CHECK(moved_boot_scans == 1);
+    CHECK(direct_boot_ms * 2 < scan_boot_ms);
+
+    // A network saved with another auth mode is joined and rejoined with it
+    SavedState mixed_state(flash_saved_state);
+    mixed_state.wifi_network.auth = CYW43_AUTH_WPA2_MIXED_PSK;
+    mixed_state.save();
+
+    int mixed_boot_scans;
+    boot(mixed_boot_scans);
+    CHECK(mixed_boot_scans == 0);
+    CHECK(join_auth == CYW43_AUTH_WPA2_MIXED_PSK);
+
+    scheduler.spawn(monitor_wifi());
+    scheduler.spawn(check_rejoin());
+    scheduler.run();
+}
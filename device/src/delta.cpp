@@ -0,0 +1,74 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "delta.h"
+
+#include "utils.h"
+
+void DeltaSink::setBase(const uint8_t *base)
+{
+    this->base = base;
+}
+
+void DeltaSink::begin(const ImageRegion &region)
+{
+    this->region = region;
+    region_offset = 0;
+    output_crc = 0;
+    output.begin(region);
+}
+
+void DeltaSink::write(const uint8_t *data, size_t len)
+{
+    if (!base)
+    {
+        output_crc = dma_crc32(data, len, output_crc);
+        output.write(data, len);
+        return;
+    }
+
+    // Rows of the region are spread out over the rows of the frame
+    size_t row_bytes = region.width / 8;
+
+    while (len > 0 && region_offset < region.size())
+    {
+        auto row = region_offset / row_bytes;
+        auto col = region_offset % row_bytes;
+        auto count = len < row_bytes - col ? len : row_bytes - col;
+        count = count < buffer.size() ? count : buffer.size();
+
+        auto frame = base + (region.y + row) * (IMAGE_WIDTH / 8) + region.x / 8 + col;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            buffer[i] = data[i] ^ frame[i];
+        }
+
+        output_crc = dma_crc32(buffer.data(), count, output_crc);
+        output.write(buffer.data(), count);
+
+        data += count;
+        len -= count;
+        region_offset += count;
+    }
+}
+
+void DeltaSink::end(bool complete)
+{
+    output.end(complete);
+}
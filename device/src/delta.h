@@ -0,0 +1,71 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "image_sink.h"
+
+/**
+ * Turns an XOR delta back into the image.
+ *
+ * In delta mode the server sends the new image XORed with the frame the
+ * device already holds, over the same region. Everything that didn't change
+ * is zero, so it compresses to almost nothing. Passes images through as they
+ * are unless a base frame is set.
+ *
+ * Either way it keeps a CRC of what it writes out, so the image can be checked
+ * against the server's before it is shown. The DMA sniffer works it out as the
+ * data goes by, which costs less than the XOR.
+ */
+class DeltaSink : public ImageSink
+{
+  public:
+    DeltaSink(ImageSink &output) : output(output)
+    {
+    }
+
+    // XOR the next image with `base`, a full frame, or pass it through if null
+    void setBase(const uint8_t *base);
+
+    void begin(const ImageRegion &region) override;
+    void write(const uint8_t *data, size_t len) override;
+    void end(bool complete) override;
+
+    size_t writable() const override
+    {
+        return output.writable();
+    }
+
+    // CRC-32 of the image written out since begin()
+    uint32_t crc() const
+    {
+        return output_crc;
+    }
+
+  private:
+    ImageSink &output;
+    const uint8_t *base = nullptr;
+
+    ImageRegion region;
+    size_t region_offset = 0;
+    uint32_t output_crc = 0;
+
+    std::array<uint8_t, 256> buffer;
+};
@@ -0,0 +1,277 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "display_worker.h"
+
+#include <string.h>
+
+#include "telemetry.h"
+
+void DisplayWorker::begin(int screen, const ImageRegion &region)
+{
+    fill_len = 0;
+    push({DisplayCommand::Type::BEGIN, screen, region});
+}
+
+void DisplayWorker::write(int screen, const uint8_t *data, size_t len)
+{
+    hard_assert(len <= writable());
+
+    while (len > 0)
+    {
+        auto &buffer = buffers[fill_buffer];
+        auto count = len < BUFFER_SIZE - fill_len ? len : BUFFER_SIZE - fill_len;
+
+        memcpy(buffer.data() + fill_len, data, count);
+        fill_len += count;
+        data += count;
+        len -= count;
+
+        if (fill_len == BUFFER_SIZE)
+        {
+            flush(screen);
+        }
+    }
+}
+
+size_t DisplayWorker::writable() const
+{
+    if (commands.space() < RESERVED_COMMANDS || buffer_in_use[fill_buffer].load(std::memory_order_acquire))
+    {
+        return 0;
+    }
+
+    // The rest of the buffer being filled, and all of the other one once core
+    // 1 has handed it back
+    auto space = BUFFER_SIZE - fill_len;
+
+    if (!buffer_in_use[1 - fill_buffer].load(std::memory_order_acquire))
+    {
+        space += BUFFER_SIZE;
+    }
+
+    return space;
+}
+
+void DisplayWorker::commit(int screen)
+{
+    flush(screen);
+    push({DisplayCommand::Type::COMMIT, screen});
+}
+
+void DisplayWorker::abort(int screen)
+{
+    fill_len = 0;
+    push({DisplayCommand::Type::ABORT, screen});
+}
+
+void DisplayWorker::sync()
+{
+    auto sync_id = requestSync();
+
+    while (!isSynced(sync_id))
+    {
+        tight_loop_contents();
+    }
+}
+
+uint32_t DisplayWorker::requestSync()
+{
+    auto sync_id = sync_requested.load(std::memory_order_relaxed) + 1;
+    sync_requested.store(sync_id, std::memory_order_relaxed);
+    push({DisplayCommand::Type::SYNC});
+
+    return sync_id;
+}
+
+bool DisplayWorker::isSynced(uint32_t sync_id) const
+{
+    return sync_done.load(std::memory_order_acquire) == sync_id;
+}
+
+bool DisplayWorker::canUpdateRegion(int screen) const
+{
+    return region_updatable[screen].load(std::memory_order_acquire);
+}
+
+bool DisplayWorker::isRunning() const
+{
+    return running.load(std::memory_order_acquire);
+}
+
+uint32_t DisplayWorker::spiBaudrate() const
+{
+    return spi_baudrate.load(std::memory_order_relaxed);
+}
+
+uint32_t DisplayWorker::takeBusyTimeUs()
+{
+    auto total = busy_time_us.load(std::memory_order_relaxed);
+    auto elapsed = total - last_busy_time_us;
+    last_busy_time_us = total;
+    return elapsed;
+}
+
+void DisplayWorker::push(const DisplayCommand &command)
+{
+    // There is always room, see RESERVED_COMMANDS
+    bool queued = commands.push(command);
+    hard_assert(queued);
+
+    // Wake up core 1
+    __sev();
+}
+
+void DisplayWorker::flush(int screen)
+{
+    if (fill_len == 0)
+    {
+        return;
+    }
+
+    buffer_in_use[fill_buffer].store(true, std::memory_order_release);
+    push({DisplayCommand::Type::WRITE, screen, {}, fill_buffer, fill_len});
+
+    fill_buffer = 1 - fill_buffer;
+    fill_len = 0;
+}
+
+void DisplayWorker::run(Waveshare13K *const *screens, size_t count, SpiTuner &spi_tuner)
+{
+    hard_assert(count <= MAX_SCREENS);
+
+    this->screens = screens;
+    this->screen_count = count;
+    this->spi_tuner = &spi_tuner;
+    spi_baudrate.store(spi_tuner.getBaudrate(), std::memory_order_relaxed);
+
+    printf("Display worker running on core %d\n", get_core_num());
+    running.store(true, std::memory_order_release);
+
+    while (true)
+    {
+        releaseBuffer();
+
+        DisplayCommand command;
+
+        if (commands.pop(command))
+        {
+            auto start = time_us_32();
+            handle(command);
+            auto elapsed_us = time_us_32() - start;
+
+            if (command.type != DisplayCommand::Type::SYNC)
+            {
+                auto total = busy_time_us.load(std::memory_order_relaxed);
+                busy_time_us.store(total + elapsed_us, std::memory_order_relaxed);
+            }
+
+            if (command.type == DisplayCommand::Type::WRITE)
+            {
+                push_time_us[command.screen] += elapsed_us;
+            }
+        }
+        else
+        {
+            scheduler.poll();
+            updateScreenState();
+
+            // Sleep until core 0 queues something or a busy pin goes low
+            best_effort_wfe_or_timeout(make_timeout_time_ms(REFRESH_CHECK_INTERVAL_MS));
+        }
+    }
+}
+
+void DisplayWorker::handle(const DisplayCommand &command)
+{
+    switch (command.type)
+    {
+    case DisplayCommand::Type::BEGIN: {
+        // A display still refreshing the last image can't take the next one.
+        // Only the time after that counts as pushing the image.
+        scheduler.wait(*screens[command.screen]);
+        auto start = time_us_32();
+        screens[command.screen]->begin(command.region);
+        push_time_us[command.screen] = time_us_32() - start;
+        break;
+    }
+    case DisplayCommand::Type::WRITE:
+        // One transfer at a time, so the last one has to finish first
+        releaseBuffer(true);
+        screens[command.screen]->write(buffers[command.buffer].data(), command.len);
+        transfer_buffer = command.buffer;
+        transfer_screen = command.screen;
+        transfer_started_us = time_us_32();
+        break;
+    case DisplayCommand::Type::COMMIT:
+        telemetry.record(Phase::SPI_PUSH, push_time_us[command.screen], command.screen);
+
+        // Shown anyway, since a few wrong pixels beat a stale image
+        if (!screens[command.screen]->verifyWrite())
+        {
+            spi_baudrate.store(spi_tuner->fallBack(), std::memory_order_relaxed);
+        }
+
+        scheduler.add(*screens[command.screen]);
+        break;
+    case DisplayCommand::Type::ABORT:
+        // Drop anything already written so the old image stays on screen
+        screens[command.screen]->shutdown();
+        break;
+    case DisplayCommand::Type::SYNC:
+        scheduler.wait();
+        updateScreenState();
+        sync_done.store(sync_requested.load(std::memory_order_relaxed), std::memory_order_release);
+        __sev();
+        break;
+    }
+
+    updateScreenState();
+}
+
+// Hands the buffer of the last write back to core 0 once its transfer is done,
+// waiting for that if `wait` is set
+void DisplayWorker::releaseBuffer(bool wait)
+{
+    if (transfer_buffer < 0)
+    {
+        return;
+    }
+
+    if (wait)
+    {
+        screens[transfer_screen]->waitForTransfer();
+    }
+    else if (screens[transfer_screen]->isTransferring())
+    {
+        return;
+    }
+
+    push_time_us[transfer_screen] += time_us_32() - transfer_started_us;
+    buffer_in_use[transfer_buffer].store(false, std::memory_order_release);
+    transfer_buffer = -1;
+    __sev();
+}
+
+void DisplayWorker::updateScreenState()
+{
+    for (size_t i = 0; i < screen_count; i++)
+    {
+        region_updatable[i].store(screens[i]->canUpdateRegion(), std::memory_order_release);
+    }
+}
@@ -0,0 +1,187 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+
+#include "image_sink.h"
+#include "refresh_scheduler.h"
+#include "spi_tuner.h"
+#include "spsc_queue.h"
+#include "waveshare.h"
+
+struct DisplayCommand
+{
+    enum class Type
+    {
+        BEGIN,
+        WRITE,
+        COMMIT,
+        ABORT,
+        SYNC,
+    };
+
+    Type type = Type::SYNC;
+    int screen = 0;
+    // For BEGIN
+    ImageRegion region = {};
+    // For WRITE
+    int buffer = 0;
+    size_t len = 0;
+};
+
+/**
+ * Drives the displays from core 1, while core 0 runs the network stack.
+ *
+ * Core 0 calls the public methods below, which queue commands for core 1.
+ * Image data is copied into one of two buffers, so core 0 can fill one while
+ * core 1 writes the other to a display. None of them wait for core 1: image
+ * data has to fit in `writable()`, which keeps room in the queue for the
+ * commands that may follow it.
+ */
+class DisplayWorker
+{
+  public:
+    void begin(int screen, const ImageRegion &region);
+    // Takes up to `writable()` bytes
+    void write(int screen, const uint8_t *data, size_t len);
+    // Bytes `write()` can take until core 1 has caught up, or 0
+    size_t writable() const;
+
+    // Shows the image written since `begin()`. The refresh runs in the
+    // background while the next image is fetched.
+    void commit(int screen);
+    // Drops the image written since `begin()`.
+    void abort(int screen);
+
+    // Waits for all queued commands and refreshes to finish.
+    void sync();
+    // Same as `sync()` without waiting. Returns an ID for `isSynced()`, which
+    // is true once everything queued before the call has finished.
+    uint32_t requestSync();
+    bool isSynced(uint32_t sync_id) const;
+
+    bool canUpdateRegion(int screen) const;
+
+    // Time core 1 has spent driving displays since the last call, not
+    // counting time spent waiting for refreshes to finish.
+    uint32_t takeBusyTimeUs();
+
+    // Whether core 1 has set up the displays and is running the worker
+    bool isRunning() const;
+
+    // SPI clock the displays are driven at, which drops if errors appear
+    uint32_t spiBaudrate() const;
+
+    // Runs the worker on core 1, with the bus already tuned by `spi_tuner`.
+    // Must only be called once.
+    [[noreturn]] void run(Waveshare13K *const *screens, size_t count, SpiTuner &spi_tuner);
+
+  private:
+    void push(const DisplayCommand &command);
+    void flush(int screen);
+    void handle(const DisplayCommand &command);
+    void releaseBuffer(bool wait = false);
+    void updateScreenState();
+
+    static constexpr size_t BUFFER_SIZE = 4096;
+    // Commands that can still be queued once writable() has dropped to 0: up
+    // to two writes from the data, and the last write, commit or abort of the
+    // image and the begin of the next, with room to spare
+    static constexpr size_t RESERVED_COMMANDS = 8;
+
+    std::array<std::array<uint8_t, BUFFER_SIZE>, 2> buffers;
+    std::array<std::atomic<bool>, 2> buffer_in_use = {};
+    // Buffer core 0 is filling, and how much of it is filled
+    int fill_buffer = 0;
+    size_t fill_len = 0;
+
+    SpscQueue<DisplayCommand, 16> commands;
+
+    std::atomic<bool> running = false;
+    std::atomic<uint32_t> spi_baudrate = 0;
+    std::atomic<uint32_t> sync_requested = 0;
+    std::atomic<uint32_t> sync_done = 0;
+
+    std::array<std::atomic<bool>, MAX_SCREENS> region_updatable = {};
+    // Only written by core 1, so core 0 can read it without a lock
+    std::atomic<uint32_t> busy_time_us = 0;
+    uint32_t last_busy_time_us = 0;
+
+    // Only used by core 1
+    Waveshare13K *const *screens = nullptr;
+    // Time spent writing the current image of each screen, without waiting
+    // for its data to arrive
+    std::array<uint32_t, MAX_SCREENS> push_time_us = {};
+    // Buffer still being sent to a display in the background, or -1
+    int transfer_buffer = -1;
+    int transfer_screen = 0;
+    uint32_t transfer_started_us = 0;
+    size_t screen_count = 0;
+    SpiTuner *spi_tuner = nullptr;
+    RefreshScheduler scheduler;
+};
+
+inline DisplayWorker display_worker;
+
+// Image sink for one display driven by the display worker.
+class ScreenSink : public ImageSink
+{
+  public:
+    ScreenSink(DisplayWorker &worker, int screen) : worker(worker), screen(screen)
+    {
+    }
+
+    void begin(const ImageRegion &region) override
+    {
+        worker.begin(screen, region);
+    }
+
+    void write(const uint8_t *data, size_t len) override
+    {
+        worker.write(screen, data, len);
+    }
+
+    size_t writable() const override
+    {
+        return worker.writable();
+    }
+
+    void end(bool complete) override
+    {
+        if (complete)
+        {
+            worker.commit(screen);
+        }
+        else
+        {
+            worker.abort(screen);
+        }
+    }
+
+    bool canUpdateRegion() const override
+    {
+        return worker.canUpdateRegion(screen);
+    }
+
+  private:
+    DisplayWorker &worker;
+    const int screen;
+};
@@ -0,0 +1,97 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "event_log.h"
+
+constexpr uint32_t EVENT_LOG_MAGIC = 0x4C545645; // "EVTL"
+
+struct EventRing
+{
+    uint32_t magic;
+    // Sequence number of the next event, its slot is that modulo the size
+    uint32_t next;
+    // Events before this one have been uploaded
+    uint32_t uploaded;
+    std::array<Event, EVENT_LOG_SIZE> events;
+};
+
+// Left as it was by the last boot. After a power cycle it holds garbage,
+// which the magic and counters are unlikely to pass as a ring.
+static EventRing __uninitialized_ram(ring);
+
+EventLog::EventLog()
+{
+    critical_section_init(&lock);
+
+    if (ring.magic != EVENT_LOG_MAGIC || ring.uploaded > ring.next)
+    {
+        ring.magic = EVENT_LOG_MAGIC;
+        ring.next = 0;
+        ring.uploaded = 0;
+    }
+
+    boot_start = ring.next;
+}
+
+void EventLog::record(EventType type, uint8_t arg, uint32_t value)
+{
+    Event event = {(uint32_t)(time_us_64() / 1000), type, arg, (uint16_t)(value < UINT16_MAX ? value : UINT16_MAX)};
+
+    critical_section_enter_blocking(&lock);
+    ring.events[ring.next % EVENT_LOG_SIZE] = event;
+    ring.next++;
+    critical_section_exit(&lock);
+}
+
+bool EventLog::hasPending() const
+{
+    return pendingStart() < boot_start;
+}
+
+size_t EventLog::copyPending(Event *events, size_t max_count, uint32_t &end)
+{
+    critical_section_enter_blocking(&lock);
+
+    auto start = pendingStart();
+    size_t count = 0;
+
+    for (auto i = start; i < boot_start && count < max_count; i++)
+    {
+        events[count++] = ring.events[i % EVENT_LOG_SIZE];
+    }
+
+    end = start + count;
+
+    critical_section_exit(&lock);
+
+    return count;
+}
+
+void EventLog::markUploaded(uint32_t end)
+{
+    critical_section_enter_blocking(&lock);
+    ring.uploaded = end;
+    critical_section_exit(&lock);
+}
+
+uint32_t EventLog::pendingStart() const
+{
+    // Events of this boot may already have overwritten the oldest ones
+    auto oldest = ring.next > EVENT_LOG_SIZE ? ring.next - EVENT_LOG_SIZE : 0;
+    return ring.uploaded > oldest ? ring.uploaded : oldest;
+}
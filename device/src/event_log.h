@@ -0,0 +1,112 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "pico/critical_section.h"
+#include "pico/stdlib.h"
+
+// Number of events kept. Only the newest ones survive a reboot, and all of them
+// have to fit in the body of one request.
+#ifndef EVENT_LOG_SIZE
+#define EVENT_LOG_SIZE 64
+#endif
+
+enum class EventType : uint8_t
+{
+    // The device started, `arg` is 1 after a watchdog reboot and 0 otherwise
+    BOOT,
+    // A phase was timed, see Telemetry. `arg` is the Phase, plus 16 times the
+    // screen for the display phases, and `value` the duration in ms.
+    PHASE,
+    // A response arrived. `arg` is the image, 0 for the manifest, and `value`
+    // the HTTP status, 0 if the request failed.
+    HTTP_STATUS,
+    // A download that broke off or came in corrupted was tried again. `arg` is
+    // the image and `value` the attempt.
+    RETRY,
+    // reset_pico() was called, `arg` is the RebootReason
+    REBOOT,
+};
+
+// Why reset_pico() rebooted, with what the event's `value` holds
+enum class RebootReason : uint8_t
+{
+    // The image, 0 if the fetch result was unknown
+    FETCH_FAILED,
+    // The screen, if its busy pin stayed high
+    BUSY_TIMEOUT,
+    // The negated flash_safe_execute() error, 0 if the saved state didn't
+    // verify
+    STATE_SAVE_FAILED,
+    // The negated CYW43_LINK_* error of rejoining the network, 0 if it timed
+    // out or couldn't be started
+    WIFI_LOST,
+};
+
+// Uploaded as is, in little-endian byte order
+struct Event
+{
+    uint32_t time_ms; // Since the boot it was recorded in
+    EventType type;
+    uint8_t arg;
+    uint16_t value; // Capped at 65535
+};
+
+static_assert(sizeof(Event) == 8);
+
+/**
+ * Ring of recent events, kept in RAM that isn't cleared at startup so that it
+ * survives the watchdog reboots of reset_pico().
+ *
+ * Tells why devices in the field are slow or reboot: the events from before
+ * the current boot are uploaded to the server once it can be reached. A power
+ * cycle loses them. Both cores record events.
+ */
+class EventLog
+{
+  public:
+    EventLog();
+
+    void record(EventType type, uint8_t arg = 0, uint32_t value = 0);
+
+    // Whether events from before this boot are left to upload
+    bool hasPending() const;
+
+    /**
+     * Copies the events from before this boot that haven't been uploaded,
+     * oldest first. Pass `end` to markUploaded() once they are.
+     *
+     * @return The number of events copied.
+     */
+    size_t copyPending(Event *events, size_t max_count, uint32_t &end);
+
+    void markUploaded(uint32_t end);
+
+  private:
+    // Oldest event from before this boot that is left to upload
+    uint32_t pendingStart() const;
+
+    critical_section_t lock;
+    // Events before this one were recorded before this boot
+    uint32_t boot_start;
+};
+
+inline EventLog event_log;
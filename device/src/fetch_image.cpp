@@ -18,156 +18,714 @@
 
 #include "fetch_image.h"
 
-#include <string>
-
-#include "pico/async_context.h"
-#include "pico/cyw43_arch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <array>
+#include <optional>
+
+#include "delta.h"
+#include "event_log.h"
+#include "http_client.h"
+#include "packbits.h"
+#include "scheduler.h"
 #include "state.h"
+#include "telemetry.h"
 #include "utils.h"
 
-uintptr_t image_buffer_offset = 0;
+// Overridden by the host build to talk to a local server
+#ifndef SERVER_HOST
+#define SERVER_HOST "api.hymnboard.sonrise.io"
+#endif
+
+#ifndef SERVER_PORT
+#define SERVER_PORT 80
+#endif
+
+// Times an image download that broke off is resumed from where it stopped, or
+// one that came in corrupted is downloaded again, before it counts as failed
+#ifndef MAX_RESUME_ATTEMPTS
+#define MAX_RESUME_ATTEMPTS 5
+#endif
+
+// Wait before resuming, longer with each attempt, to let the link recover
+constexpr uint32_t RESUME_DELAY_MS = 500;
 
-struct HttpRequest
+// Passes at most the size of the image region on to the real sink, while
+// counting all bytes of the image so that short or oversized images can be
+// rejected.
+class BoundedSink : public ImageSink
 {
-    bool complete = false;
-    httpc_result_t result;
-    u32_t status_code;
-    std::string &etag;
+  public:
+    BoundedSink(ImageSink &sink) : sink(sink)
+    {
+    }
+
+    void begin(const ImageRegion &region) override
+    {
+        this->region = region;
+        bytes_written = 0;
+        sink.begin(region);
+    }
+
+    void write(const uint8_t *data, size_t len) override
+    {
+        auto space_left = bytes_written < region.size() ? region.size() - bytes_written : 0;
+        auto bytes_to_write = len < space_left ? len : space_left;
+
+        if (bytes_to_write > 0)
+        {
+            sink.write(data, bytes_to_write);
+        }
 
-    HttpRequest(std::string &etag) : etag(etag)
+        bytes_written += len;
+    }
+
+    void end(bool complete) override
+    {
+        sink.end(complete && is_complete());
+    }
+
+    size_t writable() const override
+    {
+        return sink.writable();
+    }
+
+    size_t size() const
+    {
+        return bytes_written;
+    }
+
+    bool is_complete() const
     {
+        return bytes_written == region.size();
     }
+
+  private:
+    ImageSink &sink;
+    ImageRegion region;
+    size_t bytes_written = 0;
 };
 
-err_t on_headers_received(httpc_state_t *connection, void *arg, struct pbuf *hdr, u16_t hdr_len, u32_t content_len)
+HttpClient server(SERVER_HOST, SERVER_PORT);
+
+// Parses "x,y,width,height" from the X-Update-Region header.
+bool parse_update_region(const char *value, ImageRegion &region)
+{
+    unsigned int x, y, width, height;
+
+    if (sscanf(value, "%u,%u,%u,%u", &x, &y, &width, &height) != 4)
+    {
+        return false;
+    }
+
+    region.x = x;
+    region.y = y;
+    region.width = width;
+    region.height = height;
+
+    return x < IMAGE_WIDTH && y < IMAGE_HEIGHT && width <= IMAGE_WIDTH && height <= IMAGE_HEIGHT &&
+           region.is_valid();
+}
+
+// Header lines identifying this device, sent with every request
+int format_device_headers(char *buffer, size_t size)
 {
-    assert(arg);
-    HttpRequest *req = (HttpRequest *)arg;
+    return snprintf(buffer, size, "X-Device-Id: %s\r\nX-Saved-State-Writes: %u\r\n", unique_board_id.c_str(),
+                    (unsigned int)flash_saved_state->write_count);
+}
+
+class ImageRequest : public HttpResponseHandler
+{
+  public:
+    ImageRequest(ImageFetch &fetch) : fetch(fetch), delta(*fetch.sink), image(delta), packbits(image)
+    {
+        ask_partial = fetch.sink->canUpdateRegion();
+        ask_delta = fetch.base != nullptr;
+        formatPath();
+
+        headers_len = format_device_headers(headers.data(), headers.size());
+
+        if (!fetch.etag->empty())
+        {
+            headers_len += snprintf(headers.data() + headers_len, headers.size() - headers_len,
+                                    "If-None-Match: %s\r\n", fetch.etag->c_str());
+        }
+    }
 
-    auto offset = pbuf_strstr(hdr, "ETag: ");
+    bool send()
+    {
+        return server.get(path.data(), headers.data(), *this);
+    }
 
-    if (offset == 0xFFFF)
+    // Whether the download broke off or came in corrupted, and can be tried
+    // again
+    bool isInterrupted() const
     {
-        printf("WARNING: ETag not found in headers\n");
+        return interrupted;
     }
-    else
+
+    /**
+     * Asks for the rest of the image, from the first byte not yet received.
+     * The request is the same as before so the server produces the same body,
+     * and If-Range makes it send the whole new image if it has changed since.
+     * A corrupted image is asked for again from the start. If the request
+     * can't be queued, the attempt counts as failed and the download stays
+     * interrupted.
+     */
+    void resume()
     {
-        auto etag_start = offset + 6;
-        auto etag_end = pbuf_memfind(hdr, "\r\n", 2, etag_start);
+        event_log.record(EventType::RETRY, fetch.image, ++attempts);
 
-        if (etag_end == 0xFFFF)
+        if (bytes_received > 0)
         {
-            printf("WARNING: End of ETag header not found\n");
+            printf("Image %d: resuming at byte %zu\n", fetch.image, bytes_received);
+
+            // A copy, as GCC can't tell the ETag apart from the headers it goes in
+            ETag if_range = etag;
+            snprintf(headers.data() + headers_len, headers.size() - headers_len,
+                     "Range: bytes=%u-\r\nIf-Range: %s\r\n", (unsigned int)bytes_received, if_range.c_str());
         }
         else
         {
-            req->etag.assign((char *)hdr->payload + etag_start, etag_end - etag_start);
-            printf("ETag: %s\n", req->etag.c_str());
+            printf("Image %d: downloading again\n", fetch.image);
+            headers[headers_len] = '\0';
+        }
+
+        interrupted = false;
+        resuming = true;
+
+        // Set again from the headers of the next response
+        status_code = 0;
+        is_packbits = false;
+        is_delta = false;
+        has_crc = false;
+        region = {};
+        has_valid_region = true;
+        range_start = -1;
+
+        if (!send())
+        {
+            interrupted = true;
         }
     }
 
-    return ERR_OK;
-}
+    // Fails a download that couldn't be sent or resumed
+    void giveUp()
+    {
+        interrupted = false;
+        finish(false);
+    }
 
-err_t on_http_data_received(void *arg, struct altcp_pcb *conn, struct pbuf *p, err_t err)
-{
-    assert(arg);
+    void onHeader(const char *name, const char *value) override
+    {
+        if (strcasecmp(name, "ETag") == 0)
+        {
+            etag = value;
+        }
+        else if (strcasecmp(name, "Content-Encoding") == 0)
+        {
+            is_packbits = strcasecmp(value, "packbits") == 0;
+        }
+        else if (strcasecmp(name, "X-Delta") == 0)
+        {
+            is_delta = strcasecmp(value, "xor") == 0;
+        }
+        else if (strcasecmp(name, "X-Frame-CRC") == 0)
+        {
+            expected_crc = strtoul(value, nullptr, 16);
+            has_crc = true;
+        }
+        else if (strcasecmp(name, "Content-Range") == 0)
+        {
+            unsigned long start;
+            range_start = sscanf(value, "bytes %lu-", &start) == 1 ? (int32_t)start : -1;
+        }
+        else if (strcasecmp(name, "X-Update-Region") == 0)
+        {
+            has_valid_region = parse_update_region(value, region);
+
+            if (!has_valid_region)
+            {
+                printf("WARNING: Invalid update region\n");
+            }
+        }
+    }
+
+    void onStatus(int status_code) override
+    {
+        this->status_code = status_code;
+
+        if (resuming && status_code == 206)
+        {
+            // Picks up where the last response stopped
+            range_ok = range_start == (int32_t)bytes_received;
+
+            if (!range_ok)
+            {
+                printf("Image %d: server resumed at byte %d\n", fetch.image, range_start);
+            }
+            return;
+        }
 
-    auto space_left = image_buffer.size() - image_buffer_offset;
-    auto bytes_to_copy = p->tot_len < space_left ? p->tot_len : space_left;
+        if (sink_started)
+        {
+            // The image changed since the download broke off, so start over
+            printf("Image %d: changed while resuming, starting over\n", fetch.image);
+            body_sink().end(false);
+            sink_started = false;
+            bytes_received = 0;
+        }
 
-    auto bytes_copied = pbuf_copy_partial(p, image_buffer.data() + image_buffer_offset, bytes_to_copy, 0);
+        if (status_code != 200 || !has_valid_region || (is_delta && !fetch.base))
+        {
+            return;
+        }
+
+        if (is_delta)
+        {
+            printf("Image %d: delta against the current frame\n", fetch.image);
+        }
 
-    if (bytes_copied == 0)
+        delta.setBase(is_delta ? fetch.base : nullptr);
+
+        if (!region.is_full())
+        {
+            printf("Image %d: partial update of %dx%d at %d,%d\n", fetch.image, region.width, region.height, region.x,
+                   region.y);
+        }
+
+        body_sink().begin(region);
+        sink_started = true;
+    }
+
+    void onBody(const uint8_t *data, size_t len) override
     {
-        printf("Error copying data to image buffer\n");
-        return ERR_BUF;
+        if (sink_started && range_ok)
+        {
+            body_sink().write(data, len);
+            bytes_received += len;
+        }
     }
 
-    image_buffer_offset += bytes_copied;
+    // Bodies that aren't written anywhere are dropped as they come
+    size_t writable() const override
+    {
+        if (!sink_started || !range_ok)
+        {
+            return SIZE_MAX;
+        }
 
-    printf("Received %d, copied %d, total %d bytes\n", p->tot_len, bytes_copied, image_buffer_offset);
+        return is_packbits ? packbits.writable() : image.writable();
+    }
 
-    altcp_recved(conn, p->tot_len);
-    pbuf_free(p);
+    void onTiming(uint32_t first_byte_us, uint32_t body_us) override
+    {
+        telemetry.record(Phase::FIRST_BYTE, first_byte_us);
+        telemetry.record(Phase::BODY, body_us);
+    }
 
-    return ERR_OK;
-}
+    void onComplete(bool success) override
+    {
+        // Keep what was received, and carry on from there later. A resumed
+        // request may also fail before any response arrives.
+        bool resumable = status_code == 200 || status_code == 206 || (resuming && status_code == 0);
+
+        if (!success && sink_started && range_ok && !etag.empty() && resumable)
+        {
+            printf("Image %d: download broke off after %zu bytes\n", fetch.image, bytes_received);
+            interrupted = true;
+            return;
+        }
+
+        // Drop an image that came in corrupted before it reaches the display,
+        // and ask for it again
+        if (success && isCorrupted())
+        {
+            printf("Image %d: corrupted, %zu of %zu bytes with CRC %08x, expected %08x\n", fetch.image, image.size(),
+                   region.size(), (unsigned int)delta.crc(), (unsigned int)expected_crc);
+            body_sink().end(false);
+            sink_started = false;
+            bytes_received = 0;
+            interrupted = true;
+
+            // Dropping the image shut the display down, so it needs all of it.
+            // The frame a delta applied to may be what's wrong.
+            ask_partial = false;
+            ask_delta = ask_delta && !is_delta;
+            formatPath();
+            return;
+        }
+
+        finish(success);
+    }
+
+  private:
+    void formatPath()
+    {
+        snprintf(path.data(), path.size(), "/images/%d?encoding=packbits%s%s", fetch.image,
+                 !fetch.etag->empty() && ask_partial ? "&partial=1" : "",
+                 !fetch.etag->empty() && ask_delta ? "&delta=1" : "");
+    }
 
-void on_http_req_completed(void *arg, httpc_result_t httpc_result, u32_t rx_content_len, u32_t srv_res, err_t err)
+    // Whether the whole response arrived, but what it decoded to isn't the
+    // image the server sent. A damaged PackBits header shows as the wrong size.
+    bool isCorrupted()
+    {
+        bool has_image = status_code == 200 || (status_code == 206 && resuming && range_ok);
+
+        if (!sink_started || !has_image || !has_crc)
+        {
+            return false;
+        }
+
+        return (is_packbits && !packbits.finish()) || !image.is_complete() || delta.crc() != expected_crc;
+    }
+
+    void finish(bool success)
+    {
+        event_log.record(EventType::HTTP_STATUS, fetch.image, success ? status_code : 0);
+        fetch.result = result(success);
+
+        if (fetch.result != FetchImageResult::ERROR)
+        {
+            *fetch.etag = etag;
+        }
+
+        if (sink_started)
+        {
+            body_sink().end(fetch.result == FetchImageResult::NEW_IMAGE);
+        }
+
+        printf("Image %d: status %d, %zu bytes, ETag %s\n", fetch.image, status_code, bytes_received, etag.c_str());
+    }
+    ImageSink &body_sink()
+    {
+        if (is_packbits)
+        {
+            return packbits;
+        }
+
+        return image;
+    }
+
+    FetchImageResult result(bool success)
+    {
+        if (!success)
+        {
+            printf("Image %d: request failed\n", fetch.image);
+            return FetchImageResult::ERROR;
+        }
+
+        if (status_code == 200 || (status_code == 206 && resuming && range_ok))
+        {
+            if (!has_valid_region)
+            {
+                printf("Image %d: server sent an invalid update region\n", fetch.image);
+                return FetchImageResult::ERROR;
+            }
+
+            if (is_packbits && !packbits.finish())
+            {
+                printf("Image %d: PackBits data truncated after %zu bytes\n", fetch.image, bytes_received);
+                return FetchImageResult::ERROR;
+            }
+
+            if (!image.is_complete())
+            {
+                printf("Image %d: incomplete, %zu bytes received, %zu expected\n", fetch.image, image.size(),
+                       region.size());
+                return FetchImageResult::ERROR;
+            }
+
+            // The ETag can't be checked on the device, so a delta has to come
+            // with the CRC of the image it should turn into
+            if (is_delta && !has_crc)
+            {
+                printf("Image %d: delta without a CRC\n", fetch.image);
+                return FetchImageResult::ERROR;
+            }
+
+            if (etag.empty())
+            {
+                printf("WARNING: ETag not found in headers\n");
+            }
+
+            return FetchImageResult::NEW_IMAGE;
+        }
+        else if (status_code == 304)
+        {
+            etag = *fetch.etag;
+            return FetchImageResult::NO_CHANGE;
+        }
+        else
+        {
+            printf("Image %d: HTTP request failed with status code: %d\n", fetch.image, status_code);
+            return FetchImageResult::ERROR;
+        }
+    }
+
+    ImageFetch &fetch;
+    // Whether to ask for just the changed region, and for a delta
+    bool ask_partial = false;
+    bool ask_delta = false;
+    std::array<char, 64> path;
+    std::array<char, 256> headers;
+    int headers_len = 0;
+
+    int status_code = 0;
+    ETag etag;
+    DeltaSink delta;
+    BoundedSink image;
+    PackBitsDecoder packbits;
+    // Whether the server sent the image PackBits encoded
+    bool is_packbits = false;
+    // Whether the server sent the image XORed with the frame the device has
+    bool is_delta = false;
+    // CRC-32 of the whole image, from X-Frame-CRC
+    bool has_crc = false;
+    uint32_t expected_crc = 0;
+    // Part of the screen the server sent, if it only sent what changed
+    ImageRegion region;
+    bool has_valid_region = true;
+
+    bool sink_started = false;
+    size_t bytes_received = 0;
+
+    bool interrupted = false;
+    bool resuming = false;
+    int attempts = 0;
+    // Where the part the server sent starts, from Content-Range
+    int32_t range_start = -1;
+    // Whether the part the server sent continues the image where it stopped
+    bool range_ok = true;
+};
+
+Task<void> fetch_images(ImageFetch *fetches, size_t count)
 {
-    assert(arg);
-    HttpRequest *req = (HttpRequest *)arg;
-
-    printf("HTTP request completed with result: %d, content length: %d, server "
-           "response: %d, error: %d\n",
-           httpc_result, rx_content_len, srv_res, err);
-    req->complete = true;
-    req->status_code = srv_res;
-    req->result = httpc_result;
+    // The server handles one batch at a time, so the requests can live here
+    // instead of in the task frame
+    static std::array<std::optional<ImageRequest>, HttpClient::MAX_REQUESTS> requests;
+
+    for (size_t start = 0; start < count; start += HttpClient::MAX_REQUESTS)
+    {
+        auto batch = count - start < HttpClient::MAX_REQUESTS ? count - start : HttpClient::MAX_REQUESTS;
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            requests[i].emplace(fetches[start + i]);
+
+            // Fails the fetch like a request that got no response
+            if (!requests[i]->send())
+            {
+                requests[i]->giveUp();
+            }
+        }
+
+        co_await server.run();
+
+        // Finish downloads that broke off, e.g. on a weak Wi-Fi link, instead
+        // of starting them over, and retry those that came in corrupted
+        for (int attempt = 1; attempt <= MAX_RESUME_ATTEMPTS; attempt++)
+        {
+            bool any_interrupted = false;
+
+            for (size_t i = 0; i < batch; i++)
+            {
+                any_interrupted |= requests[i]->isInterrupted();
+            }
+
+            if (!any_interrupted)
+            {
+                break;
+            }
+
+            co_await scheduler.sleep(attempt * RESUME_DELAY_MS);
+
+            for (size_t i = 0; i < batch; i++)
+            {
+                if (requests[i]->isInterrupted())
+                {
+                    requests[i]->resume();
+                }
+            }
+
+            co_await server.run();
+        }
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            if (requests[i]->isInterrupted())
+            {
+                requests[i]->giveUp();
+            }
+        }
+
+        for (auto &request : requests)
+        {
+            request.reset();
+        }
+    }
 }
 
-FetchImageResult fetch_image(int image, std::string &etag)
+class ManifestRequest : public HttpResponseHandler
 {
-    auto context = cyw43_arch_async_context();
+  public:
+    void onStatus(int status_code) override
+    {
+        this->status_code = status_code;
+    }
+
+    void onBody(const uint8_t *data, size_t len) override
+    {
+        auto space_left = sizeof(body) - 1 - body_len;
+        auto bytes_to_copy = len < space_left ? len : space_left;
 
-    std::string path = "/images/" + std::to_string(image) + "?device_id=" + unique_board_id +
-                       "&saved_state_writes=" + std::to_string(flash_saved_state->write_count);
+        memcpy(body + body_len, data, bytes_to_copy);
+        body_len += bytes_to_copy;
+    }
 
-    // Yeah, yeah, this should be a If-None-Match header, but the http_client
-    // library doesn't support custom headers.
-    if (!etag.empty())
+    void onComplete(bool success) override
     {
-        path += "&etag=" + etag;
+        this->success = success;
+        body[body_len] = '\0';
     }
 
-    HttpRequest req(etag);
+    bool success = false;
+    int status_code = 0;
 
-    httpc_connection_t settings = {};
-    settings.headers_done_fn = on_headers_received;
-    settings.result_fn = on_http_req_completed;
+    char body[256];
+    size_t body_len = 0;
+};
+
+// Kept out of fetch_etags(), so the buffers aren't part of its task frame
+bool send_manifest_request(ManifestRequest &req, const ETag *current_etags, int count, int wait_s)
+{
+    char path[256];
+    auto len = snprintf(path, sizeof(path), "/images/manifest?wait=%d&etags=", wait_s);
 
-    image_buffer_offset = 0;
+    for (int i = 0; i < count && len < (int)sizeof(path); i++)
+    {
+        len += snprintf(path + len, sizeof(path) - len, "%s%s", i > 0 ? "," : "", current_etags[i].c_str());
+    }
 
-    auto ret = httpc_get_file_dns("api.hymnboard.sonrise.io", 80, path.c_str(), &settings, on_http_data_received, &req,
-                                  nullptr);
+    // Report how long things took since the last manifest request. Not timed
+    // itself, since the server holds it until something changes.
+    char summary[384];
+    char headers[512];
+    auto headers_len = format_device_headers(headers, sizeof(headers));
 
-    if (ret != ERR_OK)
+    if (telemetry.takeSummary(summary, sizeof(summary)) > 0)
     {
-        printf("Error starting HTTP request: %d\n", ret);
-        return FetchImageResult::ERROR;
+        snprintf(headers + headers_len, sizeof(headers) - headers_len, "X-Telemetry: %s\r\n", summary);
     }
 
-    while (!req.complete)
+    return server.get(path, headers, req);
+}
+
+Task<bool> fetch_etags(ETag *etags, const ETag *current_etags, int count, int wait_s)
+{
+    ManifestRequest req;
+
+    bool sent = send_manifest_request(req, current_etags, count, wait_s);
+    hard_assert(sent);
+    co_await server.run(wait_s * 1000 + HttpClient::DEFAULT_TIMEOUT_MS);
+
+    event_log.record(EventType::HTTP_STATUS, 0, req.success ? req.status_code : 0);
+
+    if (!req.success || req.status_code != 200)
     {
-        async_context_poll(context);
-        async_context_wait_for_work_ms(context, 1000);
+        printf("Manifest request failed, status code: %d\n", req.status_code);
+        co_return false;
     }
 
-    if (req.result != HTTPC_RESULT_OK)
+    for (int i = 0; i < count; i++)
     {
-        printf("HTTP request failed with error: %d\n", req.result);
-        return FetchImageResult::ERROR;
+        etags[i].clear();
     }
 
-    if (req.status_code == 200)
+    // One "<image> <etag>" per line
+    char *line = req.body;
+
+    while (*line)
     {
-        if (image_buffer_offset != image_buffer.size())
+        int image;
+        char etag[41];
+
+        if (sscanf(line, "%d %40s", &image, etag) == 2 && image >= 1 && image <= count)
         {
-            printf("Image buffer not full, only %d bytes received, %d expected\n", image_buffer_offset,
-                   image_buffer.size());
-            return FetchImageResult::ERROR;
+            etags[image - 1] = etag;
         }
 
-        return FetchImageResult::NEW_IMAGE;
+        auto next = strchr(line, '\n');
+
+        if (!next)
+        {
+            break;
+        }
+
+        line = next + 1;
     }
-    else if (req.status_code == 304)
+
+    co_return true;
+}
+
+// Events sent with one request, which the request buffer has room for
+constexpr size_t EVENTS_PER_UPLOAD = 64;
+
+class UploadRequest : public HttpResponseHandler
+{
+  public:
+    void onStatus(int status_code) override
     {
-        return FetchImageResult::NO_CHANGE;
+        this->status_code = status_code;
     }
-    else
+
+    void onComplete(bool success) override
     {
-        printf("HTTP request failed with status code: %d\n", req.status_code);
-        return FetchImageResult::ERROR;
+        this->success = success;
     }
+
+    bool success = false;
+    int status_code = 0;
+};
+
+// Kept out of upload_event_log(), so the buffers aren't part of its task frame
+bool send_event_log(UploadRequest &req, uint32_t &end)
+{
+    Event events[EVENTS_PER_UPLOAD];
+    auto count = event_log.copyPending(events, EVENTS_PER_UPLOAD, end);
+
+    char headers[256];
+    auto headers_len = format_device_headers(headers, sizeof(headers));
+    snprintf(headers + headers_len, sizeof(headers) - headers_len, "Content-Type: application/octet-stream\r\n");
+
+    return server.post("/events", headers, (const uint8_t *)events, count * sizeof(Event), req);
+}
+
+Task<void> upload_event_log()
+{
+    while (event_log.hasPending())
+    {
+        UploadRequest req;
+        uint32_t end;
+
+        if (!send_event_log(req, end))
+        {
+            co_return;
+        }
+
+        co_await server.run();
+
+        if (!req.success || req.status_code < 200 || req.status_code >= 300)
+        {
+            printf("Uploading the event log failed, status code: %d\n", req.status_code);
+            co_return;
+        }
+
+        event_log.markUploaded(end);
+    }
+
+    printf("Event log uploaded\n");
 }
@@ -18,11 +18,10 @@
 
 #pragma once
 
-#include <array>
-#include <string>
 
-#include "lwip/apps/http_client.h"
+#include "image_sink.h"
 #include "pico/stdlib.h"
+#include "task.h"
 
 enum class FetchImageResult
 {
@@ -31,6 +30,44 @@ enum class FetchImageResult
     ERROR,
 };
 
-inline std::array<uint8_t, 81600> image_buffer;
+struct ImageFetch
+{
+    int image;
+    // ETag of the image the sink holds, updated once a new image is complete
+    // and before the sink's end() is called
+    ETag *etag;
+    ImageSink *sink;
+    // The frame the screen shows, if the device still has it, so the server
+    // can send just how the new image differs from it
+    const uint8_t *base = nullptr;
+    FetchImageResult result = FetchImageResult::ERROR;
+};
+
+/**
+ * Fetches images from the server, streaming each into its sink as it arrives.
+ *
+ * All requests are sent at once on one persistent connection. A sink is only
+ * touched if the server sends a new image for it, and `ImageSink::end()` is
+ * only called with true if the image is complete and matches the CRC the
+ * server sent for it. Downloads that break off are resumed with a Range request
+ * from the last byte received, and corrupted ones are downloaded again.
+ * Completes once every fetch has its result.
+ */
+Task<void> fetch_images(ImageFetch *fetches, size_t count);
+
+/**
+ * Fetches the current ETag of every screen with a single request.
+ *
+ * With `wait_s` set, the server holds the request until a screen no longer
+ * has the ETag in `current_etags`, or until `wait_s` seconds have passed, so
+ * changes are picked up as soon as they are made.
+ *
+ * @param etags Set to the ETag of each screen, with `etags[0]` for image 1.
+ *              Left empty for screens the server didn't list.
+ * @return false if the request failed.
+ */
+Task<bool> fetch_etags(ETag *etags, const ETag *current_etags, int count, int wait_s = 0);
 
-FetchImageResult fetch_image(int image, std::string &etag);
+// Uploads the events recorded before this boot, see EventLog. Those that
+// can't be uploaded now are kept for the next call.
+Task<void> upload_event_log();
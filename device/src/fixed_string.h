@@ -0,0 +1,86 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+/**
+ * A string of at most N characters, stored inline instead of on the heap.
+ * Longer strings are cut off.
+ */
+template <size_t N> class FixedString
+{
+  public:
+    FixedString() = default;
+
+    FixedString(const char *value)
+    {
+        *this = value;
+    }
+
+    FixedString &operator=(const char *value)
+    {
+        return assign(value, strnlen(value, N));
+    }
+
+    // Sets the string to the first `len` characters of `value`
+    FixedString &assign(const char *value, size_t len)
+    {
+        this->len = len < N ? len : N;
+        memcpy(data, value, this->len);
+        data[this->len] = '\0';
+        return *this;
+    }
+
+    const char *c_str() const
+    {
+        return data;
+    }
+
+    size_t length() const
+    {
+        return len;
+    }
+
+    bool empty() const
+    {
+        return len == 0;
+    }
+
+    void clear()
+    {
+        len = 0;
+        data[0] = '\0';
+    }
+
+    bool operator==(const FixedString &other) const
+    {
+        return len == other.len && memcmp(data, other.data, len) == 0;
+    }
+
+    bool operator==(const char *other) const
+    {
+        return strcmp(data, other) == 0;
+    }
+
+  private:
+    char data[N + 1] = {};
+    size_t len = 0;
+};
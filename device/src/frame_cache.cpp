@@ -0,0 +1,351 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "frame_cache.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "scheduler.h"
+#include "utils.h"
+
+constexpr uint32_t FRAME_SLOT_MAGIC = 0x4D415246; // "FRAM"
+
+#if PICO_ON_DEVICE
+// End of the program in flash, from the linker script
+extern char __flash_binary_end;
+#endif
+
+FrameCache::FrameCache(const ETag *in_use, size_t in_use_count) : in_use(in_use), in_use_count(in_use_count)
+{
+#if PICO_ON_DEVICE
+    if ((uintptr_t)&__flash_binary_end > XIP_BASE + FRAME_CACHE_OFFSET)
+    {
+        printf("WARNING: Program overlaps the frame cache, disabling it\n");
+        enabled = false;
+    }
+#endif
+
+    for (int slot = 0; slot < FRAME_CACHE_SLOTS; slot++)
+    {
+        valid[slot] = enabled && isValid(slot);
+
+        if (valid[slot])
+        {
+            printf("Frame cache slot %d: %s\n", slot, header(slot)->etag);
+
+            if ((int32_t)(header(slot)->sequence - next_sequence) >= 0)
+            {
+                next_sequence = header(slot)->sequence + 1;
+            }
+        }
+    }
+}
+
+const uint8_t *FrameCache::find(const ETag &etag) const
+{
+    if (etag.empty())
+    {
+        return nullptr;
+    }
+
+    for (int slot = 0; slot < FRAME_CACHE_SLOTS; slot++)
+    {
+        if (valid[slot] && etag == header(slot)->etag)
+        {
+            return frame(slot);
+        }
+    }
+
+    return nullptr;
+}
+
+int FrameCache::allocate(const uint8_t *keep)
+{
+    if (!enabled)
+    {
+        return -1;
+    }
+
+    int oldest = -1;
+
+    for (int slot = 0; slot < FRAME_CACHE_SLOTS; slot++)
+    {
+        if (!valid[slot])
+        {
+            oldest = slot;
+            break;
+        }
+
+        if (frame(slot) == keep || isInUse(slot))
+        {
+            continue;
+        }
+
+        if (oldest < 0 || (int32_t)(header(slot)->sequence - header(oldest)->sequence) < 0)
+        {
+            oldest = slot;
+        }
+    }
+
+    if (oldest < 0)
+    {
+        printf("WARNING: No frame cache slot free\n");
+        return -1;
+    }
+
+    // The frame stays in flash until the first page erases its header
+    valid[oldest] = false;
+    erased_size[oldest] = 0;
+
+    return oldest;
+}
+
+void FrameCache::program(int slot, uint32_t offset, const uint8_t *page)
+{
+    auto slot_offset = FRAME_CACHE_OFFSET + slot * FRAME_SLOT_SIZE;
+    auto flash_offset = slot_offset + FLASH_PAGE_SIZE + offset;
+
+    // The first sector also holds the header, which commit() writes last
+    while (erased_size[slot] < FLASH_PAGE_SIZE + offset + FLASH_PAGE_SIZE)
+    {
+        auto sector_offset = slot_offset + erased_size[slot];
+        int res = flash_safe_execute([&]() { flash_range_erase(sector_offset, FLASH_SECTOR_SIZE); }, 10000);
+
+        if (res != PICO_OK)
+        {
+            // The frame fails verification in commit()
+            printf("Failed to erase frame cache slot %d: %d\n", slot, res);
+            return;
+        }
+
+        erased_size[slot] += FLASH_SECTOR_SIZE;
+    }
+
+    int res = flash_safe_execute([&]() { flash_range_program(flash_offset, page, FLASH_PAGE_SIZE); }, 10000);
+
+    if (res != PICO_OK)
+    {
+        printf("Failed to write frame cache slot %d: %d\n", slot, res);
+    }
+}
+
+bool FrameCache::commit(int slot, const ETag &etag)
+{
+    hard_assert(etag.length() <= 40);
+
+    alignas(SlotHeader) uint8_t page_buf[FLASH_PAGE_SIZE];
+    memset(page_buf, 0xFF, sizeof(page_buf));
+
+    auto slot_header = (SlotHeader *)page_buf;
+    slot_header->magic = FRAME_SLOT_MAGIC;
+    slot_header->sequence = next_sequence++;
+    slot_header->crc = crc32(frame(slot), IMAGE_SIZE);
+    strcpy(slot_header->etag, etag.c_str());
+
+    auto flash_offset = FRAME_CACHE_OFFSET + slot * FRAME_SLOT_SIZE;
+
+    int res = flash_safe_execute([&]() { flash_range_program(flash_offset, page_buf, FLASH_PAGE_SIZE); }, 10000);
+
+    if (res != PICO_OK)
+    {
+        printf("Failed to write frame cache slot %d: %d\n", slot, res);
+        return false;
+    }
+
+    valid[slot] = isValid(slot);
+
+    if (!valid[slot])
+    {
+        printf("Frame cache slot %d failed verification\n", slot);
+    }
+
+    return valid[slot];
+}
+
+const FrameCache::SlotHeader *FrameCache::header(int slot)
+{
+    return (const SlotHeader *)(XIP_BASE + FRAME_CACHE_OFFSET + slot * FRAME_SLOT_SIZE);
+}
+
+const uint8_t *FrameCache::frame(int slot)
+{
+    return (const uint8_t *)header(slot) + FLASH_PAGE_SIZE;
+}
+
+bool FrameCache::isValid(int slot) const
+{
+    auto slot_header = header(slot);
+
+    return slot_header->magic == FRAME_SLOT_MAGIC && memchr(slot_header->etag, '\0', sizeof(slot_header->etag)) &&
+           slot_header->crc == crc32(frame(slot), IMAGE_SIZE);
+}
+
+bool FrameCache::isInUse(int slot) const
+{
+    for (size_t i = 0; i < in_use_count; i++)
+    {
+        if (in_use[i] == header(slot)->etag)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void CachingSink::begin(const ImageRegion &region)
+{
+    sink.begin(region);
+
+    this->region = region;
+    region_offset = 0;
+    base = region.is_full() ? nullptr : cache.find(etag);
+
+    if (!region.is_full() && !base)
+    {
+        printf("Frame cache doesn't hold %s, not caching update\n", etag.c_str());
+        slot = -1;
+        return;
+    }
+
+    slot = cache.allocate(base);
+    page_offset = 0;
+    loadPage();
+}
+
+void CachingSink::write(const uint8_t *data, size_t len)
+{
+    sink.write(data, len);
+
+    if (slot < 0)
+    {
+        return;
+    }
+
+    // Rows of the region are spread out over the rows of the frame
+    size_t row_bytes = region.width / 8;
+
+    while (len > 0 && region_offset < region.size())
+    {
+        auto row = region_offset / row_bytes;
+        auto col = region_offset % row_bytes;
+        auto bytes_to_place = len < row_bytes - col ? len : row_bytes - col;
+
+        place((region.y + row) * (IMAGE_WIDTH / 8) + region.x / 8 + col, data, bytes_to_place);
+
+        data += bytes_to_place;
+        len -= bytes_to_place;
+        region_offset += bytes_to_place;
+    }
+}
+
+void CachingSink::end(bool complete)
+{
+    sink.end(complete);
+
+    if (slot < 0)
+    {
+        return;
+    }
+
+    if (complete && region_offset == region.size())
+    {
+        // Fill in the rest of the frame from the base frame
+        while (page_offset < IMAGE_SIZE)
+        {
+            flushPage();
+        }
+
+        if (cache.commit(slot, etag))
+        {
+            printf("Cached frame %s in slot %d\n", etag.c_str(), slot);
+        }
+    }
+
+    slot = -1;
+}
+
+// Copies part of the frame at `offset` into the page buffer, writing out
+// pages that are done. Offsets only ever increase.
+void CachingSink::place(uint32_t offset, const uint8_t *data, size_t len)
+{
+    while (len > 0)
+    {
+        while (offset >= page_offset + FLASH_PAGE_SIZE)
+        {
+            flushPage();
+        }
+
+        auto page_pos = offset - page_offset;
+        auto bytes_to_copy = len < FLASH_PAGE_SIZE - page_pos ? len : FLASH_PAGE_SIZE - page_pos;
+
+        memcpy(page.data() + page_pos, data, bytes_to_copy);
+
+        offset += bytes_to_copy;
+        data += bytes_to_copy;
+        len -= bytes_to_copy;
+    }
+}
+
+void CachingSink::flushPage()
+{
+    cache.program(slot, page_offset, page.data());
+    page_offset += FLASH_PAGE_SIZE;
+    loadPage();
+}
+
+// Starts the page at `page_offset` from the base frame, if there is one
+void CachingSink::loadPage()
+{
+    page.fill(0xFF);
+
+    if (base && page_offset < IMAGE_SIZE)
+    {
+        auto len = IMAGE_SIZE - page_offset < FLASH_PAGE_SIZE ? IMAGE_SIZE - page_offset : FLASH_PAGE_SIZE;
+        memcpy(page.data(), base + page_offset, len);
+    }
+}
+
+Task<void> show_cached_frame(ImageSink &sink, const uint8_t *frame)
+{
+    // Let the network run while core 1 writes out the previous image
+    while (sink.writable() == 0)
+    {
+        co_await scheduler.sleep(1);
+    }
+
+    sink.begin(ImageRegion());
+
+    for (size_t offset = 0; offset < IMAGE_SIZE;)
+    {
+        auto len = sink.writable();
+
+        if (len == 0)
+        {
+            co_await scheduler.sleep(1);
+            continue;
+        }
+
+        len = IMAGE_SIZE - offset < len ? IMAGE_SIZE - offset : len;
+        sink.write(frame + offset, len);
+        offset += len;
+    }
+
+    sink.end(true);
+}
@@ -0,0 +1,136 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "hardware/flash.h"
+#include "image_sink.h"
+#include "state.h"
+#include "task.h"
+
+// Number of full frames kept in flash, just below the saved state log
+#ifndef FRAME_CACHE_SLOTS
+#define FRAME_CACHE_SLOTS 6
+#endif
+
+// Each slot holds a header page followed by the packed frame
+inline constexpr uint32_t FRAME_SLOT_SIZE =
+    (FLASH_PAGE_SIZE + IMAGE_SIZE + FLASH_SECTOR_SIZE - 1) / FLASH_SECTOR_SIZE * FLASH_SECTOR_SIZE;
+inline constexpr uint32_t FRAME_CACHE_OFFSET = STATE_LOG_OFFSET - FRAME_CACHE_SLOTS * FRAME_SLOT_SIZE;
+
+/**
+ * Packed frames in flash, keyed by ETag.
+ *
+ * Lets the device redraw its screens after a reboot without the server, and
+ * skip downloading images it has already shown. Frames are read straight
+ * from flash through XIP.
+ */
+class FrameCache
+{
+  public:
+    // Frames with any of the `in_use` ETags are never evicted
+    FrameCache(const ETag *in_use, size_t in_use_count);
+
+    // Returns the cached frame with the given ETag, or nullptr
+    const uint8_t *find(const ETag &etag) const;
+
+    // Picks the slot of the oldest frame not in use, or returns -1 if there
+    // is none. `keep` is never chosen, so an update can be based on it.
+    int allocate(const uint8_t *keep);
+    // Each sector of the slot is erased just before its first page, so the
+    // erase is spread over the download instead of holding up its start
+    void program(int slot, uint32_t offset, const uint8_t *page);
+    // Makes the frame written to `slot` available under `etag`
+    bool commit(int slot, const ETag &etag);
+
+  private:
+    struct SlotHeader
+    {
+        uint32_t magic;
+        // Increases with every frame, so the oldest frame is evicted first
+        uint32_t sequence;
+        uint32_t crc;
+        char etag[41];
+    };
+
+    static const SlotHeader *header(int slot);
+    static const uint8_t *frame(int slot);
+    bool isValid(int slot) const;
+    bool isInUse(int slot) const;
+
+    const ETag *in_use;
+    const size_t in_use_count;
+    bool enabled = true;
+    uint32_t next_sequence = 0;
+    std::array<bool, FRAME_CACHE_SLOTS> valid;
+    // Bytes at the start of each allocated slot that have been erased
+    std::array<uint32_t, FRAME_CACHE_SLOTS> erased_size = {};
+};
+
+/**
+ * Passes an image on to another sink while writing it to the frame cache.
+ *
+ * An update of just a region is combined with the cached frame it applies
+ * to. `etag` is read in begin() for the frame the update applies to, and in
+ * end() for the ETag of the new frame.
+ */
+class CachingSink : public ImageSink
+{
+  public:
+    CachingSink(ImageSink &sink, FrameCache &cache, const ETag &etag) : sink(sink), cache(cache), etag(etag)
+    {
+    }
+
+    void begin(const ImageRegion &region) override;
+    void write(const uint8_t *data, size_t len) override;
+    void end(bool complete) override;
+
+    size_t writable() const override
+    {
+        return sink.writable();
+    }
+
+    bool canUpdateRegion() const override
+    {
+        return sink.canUpdateRegion();
+    }
+
+  private:
+    void place(uint32_t offset, const uint8_t *data, size_t len);
+    void flushPage();
+    void loadPage();
+
+    ImageSink &sink;
+    FrameCache &cache;
+    const ETag &etag;
+
+    // Slot being written, or -1 if the image isn't being cached
+    int slot = -1;
+    // Frame the update applies to, or nullptr for a full image
+    const uint8_t *base = nullptr;
+    ImageRegion region;
+    size_t region_offset = 0;
+
+    uint32_t page_offset = 0;
+    std::array<uint8_t, FLASH_PAGE_SIZE> page;
+};
+
+// Sends a cached frame to `sink` as a full image, as fast as it takes it
+Task<void> show_cached_frame(ImageSink &sink, const uint8_t *frame);
@@ -19,6 +19,7 @@
 #pragma once
 
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
 #include "pico/stdlib.h"
 
 constexpr bool HIGH = true;
@@ -52,6 +53,40 @@ class InputPin
         gpio_set_dir(gpio, GPIO_IN);
     }
 
+    /**
+     * Timestamps the rising and falling edges of the pin from its interrupt.
+     *
+     * The interrupt runs on the core that calls this, and wakes that core
+     * from `__wfe()`, so waiting for the pin can be combined with waiting for
+     * other events.
+     */
+    void enableEdgeInterrupts()
+    {
+        instances[gpio] = this;
+
+        // One handler serves all pins, like SPI::on_dma_irq()
+        if (!irq_handler_added)
+        {
+            irq_add_shared_handler(IO_IRQ_BANK0, on_gpio_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+            irq_handler_added = true;
+        }
+
+        gpio_set_irq_enabled(gpio, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+    }
+
+    // time_us_32() when the pin last went high or low. Only updated once edge
+    // interrupts are enabled.
+    uint32_t lastRiseUs() const
+    {
+        return last_rise_us;
+    }
+
+    uint32_t lastFallUs() const
+    {
+        return last_fall_us;
+    }
+
     bool get()
     {
         return gpio_get(gpio);
@@ -68,5 +103,37 @@ class InputPin
     }
 
   private:
+    static void on_gpio_irq()
+    {
+        auto now = time_us_32();
+
+        for (auto instance : instances)
+        {
+            if (!instance)
+            {
+                continue;
+            }
+
+            auto events = gpio_get_irq_event_mask(instance->gpio);
+
+            if (events & GPIO_IRQ_EDGE_RISE)
+            {
+                instance->last_rise_us = now;
+            }
+
+            if (events & GPIO_IRQ_EDGE_FALL)
+            {
+                instance->last_fall_us = now;
+            }
+
+            gpio_acknowledge_irq(instance->gpio, events);
+        }
+    }
+
+    inline static InputPin *instances[NUM_BANK0_GPIOS] = {};
+    inline static bool irq_handler_added = false;
+
     const uint gpio;
+    volatile uint32_t last_rise_us = 0;
+    volatile uint32_t last_fall_us = 0;
 };
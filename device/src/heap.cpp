@@ -0,0 +1,125 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// Counts the heap allocations of C and C++ code alike. On the device, the
+// linker wraps the C library's _malloc_r() and _realloc_r(), which malloc(),
+// calloc() and realloc() end up in, under pico_malloc's own wrappers of them.
+// The global operator new allocates with malloc(). On the host, where malloc()
+// stands in for lwIP's pools, only operator new is counted. lwIP and the
+// Wi-Fi driver don't allocate from the heap.
+
+#include "heap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
+
+#include "pico/stdlib.h"
+
+static volatile bool heap_locked = false;
+// Both cores allocate through here, so a count may be missed if they do at
+// the same time. Any count above zero is a bug either way.
+static volatile uint32_t late_allocations = 0;
+
+static void count_allocation([[maybe_unused]] size_t size)
+{
+    if (heap_locked)
+    {
+        late_allocations = late_allocations + 1;
+
+#if NO_HEAP_AFTER_INIT
+        printf("Heap allocation of %zu bytes after startup\n", size);
+        hard_assert(false);
+#endif
+    }
+}
+
+#if PICO_ON_DEVICE
+extern "C"
+{
+    void *__real__malloc_r(struct _reent *reent, size_t size);
+    void *__real__realloc_r(struct _reent *reent, void *ptr, size_t size);
+
+    void *__wrap__malloc_r(struct _reent *reent, size_t size)
+    {
+        count_allocation(size);
+        return __real__malloc_r(reent, size);
+    }
+
+    // Counted even if the block grows in place, which still changes the heap
+    void *__wrap__realloc_r(struct _reent *reent, void *ptr, size_t size)
+    {
+        count_allocation(size);
+        return __real__realloc_r(reent, ptr, size);
+    }
+}
+#endif
+
+static void *allocate(size_t size)
+{
+#if !PICO_ON_DEVICE
+    count_allocation(size);
+#endif
+
+    auto ptr = malloc(size);
+
+    // Exceptions are disabled, so there is nothing to throw
+    hard_assert(ptr);
+    return ptr;
+}
+
+void *operator new(size_t size)
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size)
+{
+    return allocate(size);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t /* size */) noexcept
+{
+    free(ptr);
+}
+
+void operator delete[](void *ptr, size_t /* size */) noexcept
+{
+    free(ptr);
+}
+
+void lock_heap()
+{
+    heap_locked = true;
+}
+
+uint32_t heap_allocations_after_init()
+{
+    return late_allocations;
+}
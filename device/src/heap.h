@@ -0,0 +1,34 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Set by the EHYMNBOARD_NO_HEAP build option. A heap allocation after startup
+// then stops the device instead of just being counted.
+#ifndef NO_HEAP_AFTER_INIT
+#define NO_HEAP_AFTER_INIT 0
+#endif
+
+// Marks the end of startup. Anything allocated on the heap after this is
+// reported, since running for months would fragment the heap.
+void lock_heap();
+
+// Number of heap allocations since lock_heap()
+uint32_t heap_allocations_after_init();
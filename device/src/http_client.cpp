@@ -0,0 +1,685 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "http_client.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "lwip/altcp_tcp.h"
+#include "lwip/dns.h"
+#include "pico/cyw43_arch.h"
+#include "scheduler.h"
+#include "telemetry.h"
+
+#define HTTP_USER_AGENT "eHymnBoard/1.0 (Pico W); Michael Spencer <sonrisesoftware@gmail.com>"
+
+// Connection attempts per call to run() before failing all requests
+constexpr int HTTP_MAX_CONNECTS = 3;
+
+bool HttpClient::get(const char *path, const char *headers, HttpResponseHandler &handler)
+{
+    return queue("GET", path, headers, nullptr, 0, handler);
+}
+
+bool HttpClient::post(const char *path, const char *headers, const uint8_t *body, size_t body_len,
+                      HttpResponseHandler &handler)
+{
+    return queue("POST", path, headers, body, body_len, handler);
+}
+
+bool HttpClient::queue(const char *method, const char *path, const char *headers, const uint8_t *body,
+                       size_t body_len, HttpResponseHandler &handler)
+{
+    if (request_count == requests.size())
+    {
+        printf("HTTP request queue full\n");
+        return false;
+    }
+
+    auto &request = requests[request_count];
+    char content_length[32] = "";
+
+    if (body)
+    {
+        snprintf(content_length, sizeof(content_length), "Content-Length: %u\r\n", (unsigned int)body_len);
+    }
+
+    int len = snprintf(request.text.data(), request.text.size(),
+                       "%s %s HTTP/1.1\r\n"
+                       "Host: %s\r\n"
+                       "User-Agent: " HTTP_USER_AGENT "\r\n"
+                       "Connection: keep-alive\r\n"
+                       "%s"
+                       "%s"
+                       "\r\n",
+                       method, path, host, content_length, headers);
+
+    if (len < 0 || (size_t)len + body_len >= request.text.size())
+    {
+        printf("HTTP request too long: %s\n", path);
+        return false;
+    }
+
+    if (body_len > 0)
+    {
+        memcpy(request.text.data() + len, body, body_len);
+    }
+
+    request.len = len + body_len;
+    request.handler = &handler;
+    request_count++;
+
+    return true;
+}
+
+Task<void> HttpClient::run(uint32_t timeout_ms)
+{
+    auto last_progress = get_absolute_time();
+    int connects = 0;
+
+    while (current < request_count)
+    {
+        cyw43_arch_lwip_begin();
+        if (!received)
+        {
+            received = pending;
+            received_offset = 0;
+            pending = nullptr;
+        }
+        bool closed = remote_closed;
+        cyw43_arch_lwip_end();
+
+        if (received)
+        {
+            auto used = handleReceived();
+            bool done = received_offset == received->tot_len;
+
+            cyw43_arch_lwip_begin();
+            if (used > 0 && pcb && state == ConnectionState::CONNECTED)
+            {
+                altcp_recved(pcb, used);
+            }
+            if (done)
+            {
+                pbuf_free(received);
+                received = nullptr;
+            }
+            cyw43_arch_lwip_end();
+
+            // Waiting for the displays counts as progress
+            last_progress = get_absolute_time();
+            connects = 0;
+
+            if (!done)
+            {
+                co_await scheduler.sleep(1);
+            }
+            continue;
+        }
+
+        if (closed)
+        {
+            handleDisconnect();
+            continue;
+        }
+
+        if (absolute_time_diff_us(last_progress, get_absolute_time()) > (int64_t)timeout_ms * 1000)
+        {
+            printf("Timeout waiting for %s\n", host);
+
+            if (response_started)
+            {
+                completeResponse(false);
+            }
+
+            disconnect();
+            last_progress = get_absolute_time();
+            continue;
+        }
+
+        if (state == ConnectionState::DISCONNECTED)
+        {
+            if (connects == HTTP_MAX_CONNECTS)
+            {
+                printf("Giving up on %s after %d connection attempts\n", host, connects);
+
+                while (current < request_count)
+                {
+                    completeResponse(false);
+                }
+                break;
+            }
+
+            connects++;
+            connect();
+            continue;
+        }
+
+        if (state == ConnectionState::RESOLVED)
+        {
+            telemetry.record(Phase::DNS, time_us_32() - connect_phase_us);
+            connect_phase_us = time_us_32();
+            timing_connect = true;
+
+            cyw43_arch_lwip_begin();
+            state = ConnectionState::CONNECTING;
+            auto err = altcp_connect(pcb, &address, port, onConnected);
+            cyw43_arch_lwip_end();
+
+            if (err != ERR_OK)
+            {
+                printf("Error connecting to %s: %d\n", host, err);
+                disconnect();
+            }
+            continue;
+        }
+
+        if (state == ConnectionState::CONNECTED && timing_connect)
+        {
+            telemetry.record(Phase::TCP_CONNECT, time_us_32() - connect_phase_us);
+            timing_connect = false;
+        }
+
+        if (state == ConnectionState::CONNECTED && sent < request_count)
+        {
+            sendRequests();
+        }
+
+        co_await scheduler.waitForWork(10);
+    }
+
+    request_count = 0;
+    sent = 0;
+    current = 0;
+}
+
+void HttpClient::connect()
+{
+    parse_state = ParseState::STATUS_LINE;
+    line_len = 0;
+    connect_phase_us = time_us_32();
+    timing_connect = false;
+
+    cyw43_arch_lwip_begin();
+
+    pcb = altcp_tcp_new_ip_type(IPADDR_TYPE_ANY);
+
+    if (!pcb)
+    {
+        cyw43_arch_lwip_end();
+        printf("Error creating connection\n");
+        return;
+    }
+
+    altcp_arg(pcb, this);
+    altcp_recv(pcb, onReceived);
+    altcp_err(pcb, onError);
+
+    state = ConnectionState::RESOLVING;
+    auto err = dns_gethostbyname(host, &address, onDnsFound, this);
+
+    if (err == ERR_OK)
+    {
+        // Already in lwIP's DNS cache
+        state = ConnectionState::RESOLVED;
+    }
+    else if (err != ERR_INPROGRESS)
+    {
+        printf("Error resolving %s: %d\n", host, err);
+        altcp_abort(pcb);
+        pcb = nullptr;
+        state = ConnectionState::DISCONNECTED;
+    }
+
+    cyw43_arch_lwip_end();
+}
+
+void HttpClient::disconnect()
+{
+    cyw43_arch_lwip_begin();
+
+    if (pcb)
+    {
+        altcp_arg(pcb, nullptr);
+        altcp_recv(pcb, nullptr);
+        altcp_err(pcb, nullptr);
+
+        if (altcp_close(pcb) != ERR_OK)
+        {
+            altcp_abort(pcb);
+        }
+
+        pcb = nullptr;
+    }
+
+    if (pending)
+    {
+        pbuf_free(pending);
+        pending = nullptr;
+    }
+
+    state = ConnectionState::DISCONNECTED;
+    remote_closed = false;
+
+    cyw43_arch_lwip_end();
+
+    // Requests that were sent but not answered are sent again on the next
+    // connection
+    sent = current;
+}
+
+void HttpClient::sendRequests()
+{
+    cyw43_arch_lwip_begin();
+
+    while (sent < request_count)
+    {
+        auto &request = requests[sent];
+
+        if (altcp_sndbuf(pcb) < request.len)
+        {
+            break;
+        }
+
+        auto err = altcp_write(pcb, request.text.data(), request.len, TCP_WRITE_FLAG_COPY);
+
+        if (err != ERR_OK)
+        {
+            printf("Error sending request: %d\n", err);
+            break;
+        }
+
+        request.sent_us = time_us_32();
+        sent++;
+    }
+
+    altcp_output(pcb);
+
+    cyw43_arch_lwip_end();
+}
+
+size_t HttpClient::handleReceived()
+{
+    auto q = received;
+    auto skip = received_offset;
+
+    while (skip >= q->len)
+    {
+        skip -= q->len;
+        q = q->next;
+    }
+
+    size_t used = 0;
+
+    for (; q != nullptr; q = q->next, skip = 0)
+    {
+        auto len = q->len - skip;
+        auto count = handleData((const uint8_t *)q->payload + skip, len);
+        used += count;
+
+        if (count < len)
+        {
+            break;
+        }
+    }
+
+    received_offset += used;
+    return used;
+}
+
+// Returns the number of bytes used, which is less than `len` only if the
+// handler has no room for the rest of the body yet
+size_t HttpClient::handleData(const uint8_t *data, size_t len)
+{
+    auto start = data;
+
+    while (len > 0 && current < request_count)
+    {
+        if (!response_started)
+        {
+            first_byte_us = time_us_32();
+            response_started = true;
+        }
+
+        if (parse_state == ParseState::BODY || parse_state == ParseState::CHUNK_DATA)
+        {
+            size_t count = len;
+
+            if (body_remaining >= 0 && (size_t)body_remaining < count)
+            {
+                count = body_remaining;
+            }
+
+            auto writable = requests[current].handler->writable();
+
+            if (writable < count)
+            {
+                count = writable;
+            }
+
+            if (count == 0)
+            {
+                return data - start;
+            }
+
+            requests[current].handler->onBody(data, count);
+            data += count;
+            len -= count;
+
+            if (body_remaining >= 0)
+            {
+                body_remaining -= count;
+
+                if (body_remaining == 0 && parse_state == ParseState::CHUNK_DATA)
+                {
+                    parse_state = ParseState::CHUNK_END;
+                }
+                else if (body_remaining == 0)
+                {
+                    completeResponse(true);
+                }
+            }
+
+            continue;
+        }
+
+        auto c = (char)*data++;
+        len--;
+
+        if (c == '\n')
+        {
+            // Drop the \r of the \r\n line ending
+            if (line_len > 0 && line[line_len - 1] == '\r')
+            {
+                line_len--;
+            }
+
+            line[line_len] = '\0';
+            handleLine();
+            line_len = 0;
+        }
+        else if (line_len < line.size() - 1)
+        {
+            line[line_len++] = c;
+        }
+    }
+
+    // Anything after the last response is dropped
+    return data - start + len;
+}
+
+void HttpClient::handleLine()
+{
+    auto handler = requests[current].handler;
+
+    if (parse_state == ParseState::STATUS_LINE)
+    {
+        unsigned int major, minor;
+
+        if (sscanf(line.data(), "HTTP/%u.%u %d", &major, &minor, &status_code) != 3)
+        {
+            printf("Invalid HTTP status line: %s\n", line.data());
+            completeResponse(false);
+            disconnect();
+            return;
+        }
+
+        parse_state = ParseState::HEADERS;
+        body_remaining = -1;
+        chunked = false;
+        keep_alive = major > 1 || minor >= 1;
+        return;
+    }
+
+    if (parse_state != ParseState::HEADERS)
+    {
+        handleChunkLine();
+        return;
+    }
+
+    if (line_len > 0)
+    {
+        auto colon = strchr(line.data(), ':');
+
+        if (!colon)
+        {
+            return;
+        }
+
+        *colon = '\0';
+        auto name = line.data();
+        auto value = colon + 1;
+
+        while (*value == ' ')
+        {
+            value++;
+        }
+
+        if (strcasecmp(name, "Content-Length") == 0)
+        {
+            body_remaining = atol(value);
+        }
+        else if (strcasecmp(name, "Connection") == 0)
+        {
+            keep_alive = strcasecmp(value, "close") != 0;
+        }
+        else if (strcasecmp(name, "Transfer-Encoding") == 0)
+        {
+            // Other codings, like gzip, can't be decoded here
+            if (strcasecmp(value, "chunked") != 0)
+            {
+                printf("Unsupported transfer encoding: %s\n", value);
+                completeResponse(false);
+                disconnect();
+                return;
+            }
+
+            chunked = true;
+        }
+
+        handler->onHeader(name, value);
+        return;
+    }
+
+    // An empty line ends the headers
+    if (status_code >= 100 && status_code < 200)
+    {
+        // Informational responses are followed by the real one
+        parse_state = ParseState::STATUS_LINE;
+        return;
+    }
+
+    handler->onStatus(status_code);
+
+    if (status_code == 204 || status_code == 304)
+    {
+        body_remaining = 0;
+    }
+    else if (chunked)
+    {
+        // The length of a chunked body is in the chunks, whatever the
+        // Content-Length says
+        parse_state = ParseState::CHUNK_SIZE;
+        return;
+    }
+
+    if (body_remaining < 0)
+    {
+        // The body ends when the server closes the connection
+        keep_alive = false;
+    }
+
+    parse_state = ParseState::BODY;
+
+    if (body_remaining == 0)
+    {
+        completeResponse(true);
+    }
+}
+
+// Lines around the data of a chunked body: the size of each chunk in hex, the
+// line ending after its data, and after the last chunk, which is empty, any
+// trailer headers up to an empty line
+void HttpClient::handleChunkLine()
+{
+    if (parse_state == ParseState::CHUNK_SIZE)
+    {
+        char *end;
+        auto size = strtoul(line.data(), &end, 16);
+
+        // Chunk extensions after a ; are ignored
+        if (end == line.data() || (*end != '\0' && *end != ';' && *end != ' ') || size > INT32_MAX)
+        {
+            printf("Invalid chunk size: %s\n", line.data());
+            completeResponse(false);
+            disconnect();
+            return;
+        }
+
+        body_remaining = size;
+        parse_state = size > 0 ? ParseState::CHUNK_DATA : ParseState::TRAILERS;
+    }
+    else if (parse_state == ParseState::CHUNK_END)
+    {
+        if (line_len > 0)
+        {
+            printf("Chunk longer than its size\n");
+            completeResponse(false);
+            disconnect();
+            return;
+        }
+
+        parse_state = ParseState::CHUNK_SIZE;
+    }
+    else if (parse_state == ParseState::TRAILERS && line_len == 0)
+    {
+        completeResponse(true);
+    }
+}
+
+void HttpClient::completeResponse(bool success)
+{
+    auto &request = requests[current];
+
+    if (success)
+    {
+        request.handler->onTiming(first_byte_us - request.sent_us, time_us_32() - first_byte_us);
+    }
+
+    request.handler->onComplete(success);
+    current++;
+
+    parse_state = ParseState::STATUS_LINE;
+    line_len = 0;
+    response_started = false;
+
+    if (!keep_alive)
+    {
+        keep_alive = true;
+        disconnect();
+    }
+}
+
+void HttpClient::handleDisconnect()
+{
+    if (parse_state == ParseState::BODY && body_remaining < 0)
+    {
+        // The body was read until the connection closed
+        completeResponse(true);
+    }
+    else if (response_started)
+    {
+        // The response was cut off, don't risk handing it over twice
+        printf("Connection to %s closed during response\n", host);
+        completeResponse(false);
+    }
+
+    disconnect();
+}
+
+void HttpClient::onDnsFound(const char *name, const ip_addr_t *ipaddr, void *arg)
+{
+    auto client = static_cast<HttpClient *>(arg);
+
+    if (client->state != ConnectionState::RESOLVING || !client->pcb)
+    {
+        return;
+    }
+
+    if (ipaddr)
+    {
+        client->address = *ipaddr;
+        client->state = ConnectionState::RESOLVED;
+    }
+    else
+    {
+        printf("Error resolving %s\n", name);
+        altcp_abort(client->pcb);
+        client->pcb = nullptr;
+        client->state = ConnectionState::DISCONNECTED;
+    }
+}
+
+err_t HttpClient::onConnected(void *arg, struct altcp_pcb * /* pcb */, err_t /* err */)
+{
+    auto client = static_cast<HttpClient *>(arg);
+    client->state = ConnectionState::CONNECTED;
+    return ERR_OK;
+}
+
+err_t HttpClient::onReceived(void *arg, struct altcp_pcb * /* pcb */, struct pbuf *p, err_t /* err */)
+{
+    auto client = static_cast<HttpClient *>(arg);
+
+    if (!p)
+    {
+        client->remote_closed = true;
+        return ERR_OK;
+    }
+
+    // Handled by run(), which opens the receive window again once the data has
+    // been used
+    if (client->pending)
+    {
+        pbuf_cat(client->pending, p);
+    }
+    else
+    {
+        client->pending = p;
+    }
+
+    return ERR_OK;
+}
+
+void HttpClient::onError(void *arg, err_t err)
+{
+    auto client = static_cast<HttpClient *>(arg);
+
+    if (!client)
+    {
+        return;
+    }
+
+    printf("Connection error: %d\n", err);
+    // lwIP has already freed the connection
+    client->pcb = nullptr;
+    client->remote_closed = true;
+    client->state = ConnectionState::DISCONNECTED;
+}
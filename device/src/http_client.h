@@ -0,0 +1,194 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "lwip/altcp.h"
+#include "lwip/ip_addr.h"
+#include "pico/stdlib.h"
+#include "task.h"
+
+// Receives the response to a request made with HttpClient. All methods are
+// called from HttpClient::run(), never from the lwIP context.
+class HttpResponseHandler
+{
+  public:
+    virtual void onStatus(int /* status_code */)
+    {
+    }
+
+    // `name` and `value` are only valid during the call.
+    virtual void onHeader(const char * /* name */, const char * /* value */)
+    {
+    }
+
+    virtual void onBody(const uint8_t * /* data */, size_t /* len */)
+    {
+    }
+
+    // Body bytes `onBody()` can take now. The rest is left in the receive
+    // window until there is room, which stops the server from sending more.
+    virtual size_t writable() const
+    {
+        return SIZE_MAX;
+    }
+
+    // Called before `onComplete()` for a successful response, with the time
+    // from sending the request to the first byte of the response and from
+    // there to the last byte. Responses to pipelined requests also wait for
+    // the responses before them.
+    virtual void onTiming(uint32_t /* first_byte_us */, uint32_t /* body_us */)
+    {
+    }
+
+    // Called exactly once, after the whole response has been received or the
+    // request has failed.
+    virtual void onComplete(bool success) = 0;
+};
+
+/**
+ * Minimal HTTP/1.1 client for a single server.
+ *
+ * Keeps one persistent connection open between calls to `run()`, and sends
+ * all queued requests back to back without waiting for each response. Needs
+ * no heap: requests are formatted into fixed buffers and response headers are
+ * parsed one line at a time. Bodies may be sent with a Content-Length, in
+ * chunks, or until the connection closes. DNS lookups go through lwIP's DNS
+ * cache, which honors the record's TTL.
+ */
+class HttpClient
+{
+  public:
+    static constexpr size_t MAX_REQUESTS = 4;
+    // Give up on the server after this long without any progress
+    static constexpr uint32_t DEFAULT_TIMEOUT_MS = 30 * 1000;
+
+    HttpClient(const char *host, u16_t port) : host(host), port(port)
+    {
+    }
+
+    /**
+     * Queues a GET request.
+     *
+     * @param headers Extra header lines, each ending with "\r\n".
+     * @return false if the request doesn't fit in the queue.
+     */
+    bool get(const char *path, const char *headers, HttpResponseHandler &handler);
+
+    /**
+     * Queues a POST request. The body is copied, and has to fit in the
+     * request buffer along with everything else.
+     *
+     * @param headers Extra header lines, each ending with "\r\n".
+     * @return false if the request doesn't fit in the queue.
+     */
+    bool post(const char *path, const char *headers, const uint8_t *body, size_t body_len,
+              HttpResponseHandler &handler);
+
+    // Sends all queued requests and handles their responses, returning once
+    // every handler has completed. `timeout_ms` has to cover the time the
+    // server may hold a request before answering.
+    Task<void> run(uint32_t timeout_ms = DEFAULT_TIMEOUT_MS);
+
+  private:
+    enum class ConnectionState
+    {
+        DISCONNECTED,
+        RESOLVING,
+        RESOLVED,
+        CONNECTING,
+        CONNECTED,
+    };
+
+    enum class ParseState
+    {
+        STATUS_LINE,
+        HEADERS,
+        BODY,
+        // Parts of a chunked body
+        CHUNK_SIZE,
+        CHUNK_DATA,
+        CHUNK_END,
+        TRAILERS,
+    };
+
+    struct Request
+    {
+        std::array<char, 1024> text;
+        size_t len;
+        HttpResponseHandler *handler;
+        uint32_t sent_us;
+    };
+
+    bool queue(const char *method, const char *path, const char *headers, const uint8_t *body, size_t body_len,
+               HttpResponseHandler &handler);
+    void connect();
+    void disconnect();
+    void sendRequests();
+    size_t handleReceived();
+    size_t handleData(const uint8_t *data, size_t len);
+    void handleLine();
+    void handleChunkLine();
+    void completeResponse(bool success);
+    void handleDisconnect();
+
+    static void onDnsFound(const char *name, const ip_addr_t *ipaddr, void *arg);
+    static err_t onConnected(void *arg, struct altcp_pcb *pcb, err_t err);
+    static err_t onReceived(void *arg, struct altcp_pcb *pcb, struct pbuf *p, err_t err);
+    static void onError(void *arg, err_t err);
+
+    const char *host;
+    const u16_t port;
+
+    // Set from the lwIP context
+    volatile ConnectionState state = ConnectionState::DISCONNECTED;
+    volatile bool remote_closed = false;
+    struct altcp_pcb *pcb = nullptr;
+    ip_addr_t address;
+    struct pbuf *pending = nullptr;
+
+    // Data taken from `pending` that the handler had no room for yet
+    struct pbuf *received = nullptr;
+    size_t received_offset = 0;
+
+    // Start of the DNS lookup, then of the TCP connection
+    uint32_t connect_phase_us = 0;
+    bool timing_connect = false;
+
+    std::array<Request, MAX_REQUESTS> requests;
+    size_t request_count = 0;
+    // Requests before `sent` have been sent on the current connection
+    size_t sent = 0;
+    // Requests before `current` have been completed
+    size_t current = 0;
+
+    ParseState parse_state = ParseState::STATUS_LINE;
+    std::array<char, 256> line;
+    size_t line_len = 0;
+    int status_code = 0;
+    // Body bytes left, or -1 if the body ends when the connection is closed.
+    // For a chunked body, the bytes left in the current chunk.
+    int32_t body_remaining = 0;
+    bool chunked = false;
+    bool keep_alive = true;
+    // Whether any of the current response has been received
+    bool response_started = false;
+    uint32_t first_byte_us = 0;
+};
@@ -0,0 +1,94 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "fixed_string.h"
+
+inline constexpr uint16_t IMAGE_WIDTH = 960;
+inline constexpr uint16_t IMAGE_HEIGHT = 680;
+inline constexpr size_t IMAGE_SIZE = IMAGE_WIDTH / 8 * IMAGE_HEIGHT;
+
+// Bounded by the ETags that fit in a saved state, which is one flash page
+inline constexpr size_t MAX_SCREENS = 4;
+
+// Identifies an image, e.g. 2e16e58b5d7ca51f8e5972e3de922816bab545bf
+using ETag = FixedString<40>;
+
+// A rectangle of the screen. x and width are multiples of 8 so that rows
+// start and end on whole bytes of the packed image.
+struct ImageRegion
+{
+    uint16_t x = 0;
+    uint16_t y = 0;
+    uint16_t width = IMAGE_WIDTH;
+    uint16_t height = IMAGE_HEIGHT;
+
+    size_t size() const
+    {
+        return width / 8 * height;
+    }
+
+    bool is_full() const
+    {
+        return x == 0 && y == 0 && width == IMAGE_WIDTH && height == IMAGE_HEIGHT;
+    }
+
+    bool is_valid() const
+    {
+        return x % 8 == 0 && width % 8 == 0 && width > 0 && height > 0 && x + width <= IMAGE_WIDTH &&
+               y + height <= IMAGE_HEIGHT;
+    }
+};
+
+// Receives a new image while it is still being downloaded.
+class ImageSink
+{
+  public:
+    // Called once the server has started sending a new image, or the part of
+    // it in `region` if only that part changed.
+    virtual void begin(const ImageRegion &region) = 0;
+
+    // Called with each chunk of the image, in order. The data is only valid
+    // for the duration of the call.
+    virtual void write(const uint8_t *data, size_t len) = 0;
+
+    // Bytes the next writes may add up to without waiting, e.g. for core 1 to
+    // hand back a buffer. Callers that can't wait hold the rest back until
+    // there is room.
+    virtual size_t writable() const
+    {
+        return SIZE_MAX;
+    }
+
+    // Called after the last write, with whether the image is complete and
+    // verified. An incomplete image must not be shown.
+    virtual void end(bool /* complete */)
+    {
+    }
+
+    // Whether the sink still holds the last image, so it can be sent just the
+    // region that changed.
+    virtual bool canUpdateRegion() const
+    {
+        return false;
+    }
+};
@@ -87,6 +87,4 @@
 #define SLIP_DEBUG       LWIP_DBG_OFF
 #define DHCP_DEBUG       LWIP_DBG_OFF
 
-#define HTTPC_CLIENT_AGENT "eHymnBoard/1.0 (Pico W); Michael Spencer <sonrisesoftware@gmail.com>"
-
 #endif /* __LWIPOPTS_H__ */
@@ -16,17 +16,27 @@
  * along with this program.  If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include "display_worker.h"
+#include "event_log.h"
 #include "fetch_image.h"
+#include "frame_cache.h"
+#include "heap.h"
 #include "hardware/watchdog.h"
 #include "pico/cyw43_arch.h"
+#include "pico/flash.h"
+#include "pico/multicore.h"
 #include "pico/stdlib.h"
 #include "pico/unique_id.h"
+#include "power.h"
+#include "scheduler.h"
+#include "screens.h"
 #include "state.h"
 #include "utils.h"
 #include "waveshare.h"
 #include "wifi.h"
 #include <array>
 #include <iostream>
+#include <optional>
 #include <stdio.h>
 
 void stall()
@@ -39,37 +49,252 @@ void stall()
     }
 }
 
-bool refresh_screen(int screen_id, Waveshare13K &screen, std::string &etag)
+// Core 1 owns the SPI bus and the displays, see DisplayWorker
+void core1_main()
 {
-    printf("Refreshing screen %d\n", screen_id);
-    auto ret = fetch_image(screen_id, etag);
+    // Let core 0 pause this core while it writes to flash
+    flash_safe_execute_core_init();
 
-    if (ret == FetchImageResult::NEW_IMAGE)
+    SPI spi(spi0, SPI_1MHZ,
+            2, // SCK pin
+            3, // MOSI pin
+            4  // MISO pin
+    );
+
+    std::array<std::optional<Waveshare13K>, SCREEN_COUNT> displays;
+    Waveshare13K *screens[SCREEN_COUNT];
+
+    for (int i = 0; i < SCREEN_COUNT; i++)
+    {
+        auto &pins = SCREENS[i];
+        displays[i].emplace(spi, i + 1, pins.power, pins.cs, pins.dc, pins.reset, pins.busy);
+        screens[i] = &*displays[i];
+    }
+
+    // Core 0 doesn't save a new state until the worker runs
+    SpiTuner spi_tuner(spi, screens, SCREEN_COUNT);
+    spi_tuner.tune(flash_saved_state->saved_spi_baudrate());
+
+    display_worker.run(screens, SCREEN_COUNT, spi_tuner);
+}
+
+// How long the server may hold a manifest request waiting for a change, in
+// seconds. Kept below the 60 s read timeout of the proxy in front of the server.
+#ifndef LONG_POLL_WAIT_S
+#define LONG_POLL_WAIT_S 50
+#endif
+
+// Poll no more often than this when the server answers without waiting, or a
+// poll changed nothing
+#ifndef MIN_POLL_INTERVAL_MS
+#define MIN_POLL_INTERVAL_MS (10 * 1000)
+#endif
+
+// Returns whether the screen got a new image. The sink has already committed
+// or dropped the image by the time its fetch completes.
+bool handle_fetch_result(const ImageFetch &fetch)
+{
+    if (fetch.result == FetchImageResult::NEW_IMAGE)
     {
-        printf("New image for screen %d\n", screen_id);
-        screen.init();
-        screen.display(image_buffer);
-        screen.shutdown();
+        printf("New image for screen %d\n", fetch.image);
         return true;
     }
-    else if (ret == FetchImageResult::NO_CHANGE)
+    else if (fetch.result == FetchImageResult::NO_CHANGE)
     {
-        printf("No change for screen %d\n", screen_id);
+        printf("No change for screen %d\n", fetch.image);
     }
-    else if (ret == FetchImageResult::ERROR)
+    else if (fetch.result == FetchImageResult::ERROR)
     {
-        printf("Refreshing screen %d failed: %d\n", screen_id, ret);
-        reset_pico();
+        printf("Refreshing screen %d failed: %d\n", fetch.image, (int)fetch.result);
+        display_worker.sync();
+        reset_pico(RebootReason::FETCH_FAILED, fetch.image);
     }
     else
     {
-        printf("Unknown result for screen %d: %d\n", screen_id, ret);
-        reset_pico();
+        printf("Unknown result for screen %d: %d\n", fetch.image, (int)fetch.result);
+        reset_pico(RebootReason::FETCH_FAILED);
     }
 
     return false;
 }
 
+// Whether a screen has to be fetched, based on the ETag the manifest lists
+// for it. Without a manifest every screen has to be checked.
+bool is_outdated(bool have_manifest, const ETag &latest_etag, const ETag &etag)
+{
+    return !have_manifest || latest_etag.empty() || latest_etag != etag;
+}
+
+// Waits for core 1 to finish everything queued so far, letting other tasks
+// run meanwhile
+Task<void> sync_displays()
+{
+    auto sync_id = display_worker.requestSync();
+
+    while (!display_worker.isSynced(sync_id))
+    {
+        co_await scheduler.sleep(10);
+    }
+}
+
+// The panels lost their RAM with the reboot. Redraws them from the cache,
+// which works without the server and lets them be updated partially again.
+Task<void> restore_screens(FrameCache &frame_cache, const ETag *etags, ImageSink *const *screens)
+{
+    for (int i = 0; i < SCREEN_COUNT; i++)
+    {
+        auto frame = frame_cache.find(etags[i]);
+
+        if (frame)
+        {
+            printf("Restoring screen %d from the frame cache\n", i + 1);
+            co_await show_cached_frame(*screens[i], frame);
+        }
+    }
+
+    // Done before the first poll, so a new image never starts loading into a
+    // display that is still refreshing the restored one
+    co_await sync_displays();
+}
+
+// Keeps the screens up to date with the server
+Task<void> refresh_loop(FrameCache &frame_cache, ETag *etags, ImageSink *const *screens,
+                        ImageSink *const *sinks)
+{
+    co_await restore_screens(frame_cache, etags, screens);
+
+    while (true)
+    {
+        // Tell the server what led up to the last reboot
+        if (event_log.hasPending())
+        {
+            co_await upload_event_log();
+        }
+
+        printf("Waiting for changes...\n");
+        auto wait_start = time_us_32();
+
+        // Check all screens with one request that the server holds until one
+        // of them changes, and only fetch those that changed
+        set_radio_mode(RadioMode::POWER_SAVE);
+
+        ETag latest_etags[SCREEN_COUNT];
+        bool have_manifest = co_await fetch_etags(latest_etags, etags, SCREEN_COUNT, LONG_POLL_WAIT_S);
+
+        auto cycle_start = time_us_32();
+
+        if (!have_manifest)
+        {
+            printf("Manifest unavailable, checking each screen...\n");
+        }
+
+        ImageFetch fetches[SCREEN_COUNT];
+        size_t fetch_count = 0;
+        bool updated = false;
+
+        for (int i = 0; i < SCREEN_COUNT; i++)
+        {
+            if (!is_outdated(have_manifest, latest_etags[i], etags[i]))
+            {
+                continue;
+            }
+
+            // Skip the download if the new image has been shown before
+            auto frame = have_manifest ? frame_cache.find(latest_etags[i]) : nullptr;
+
+            if (frame)
+            {
+                printf("Showing cached image for screen %d\n", i + 1);
+                co_await show_cached_frame(*screens[i], frame);
+                etags[i] = latest_etags[i];
+                updated = true;
+            }
+            else
+            {
+                printf("Refreshing screen %d\n", i + 1);
+                fetches[fetch_count++] = {i + 1, &etags[i], sinks[i], frame_cache.find(etags[i])};
+            }
+        }
+
+        if (fetch_count > 0)
+        {
+            set_radio_mode(RadioMode::ACTIVE);
+        }
+
+        // Core 1 refreshes each display as soon as its image is in, while the
+        // rest are still being received
+        co_await fetch_images(fetches, fetch_count);
+
+        set_radio_mode(RadioMode::POWER_SAVE);
+
+        for (size_t i = 0; i < fetch_count; i++)
+        {
+            updated |= handle_fetch_result(fetches[i]);
+        }
+
+        auto fetch_time_us = time_us_32() - cycle_start;
+
+        // Wait for the displays to finish refreshing before saving their ETags
+        co_await sync_displays();
+
+        auto cycle_time_us = time_us_32() - cycle_start;
+        auto display_time_us = display_worker.takeBusyTimeUs();
+
+        printf("Cycle took %d ms: core 0 fetching %d ms, core 1 driving displays %d ms\n", cycle_time_us / 1000,
+               fetch_time_us / 1000, display_time_us / 1000);
+
+        // Keep the SPI clock for the next boot, once it has been calibrated or
+        // lowered after an error
+        auto spi_baudrate = display_worker.spiBaudrate();
+        bool spi_changed = spi_baudrate != flash_saved_state->saved_spi_baudrate();
+
+        if (updated || spi_changed)
+        {
+            printf("%s, saving state...\n", updated ? "One or more screens updated" : "SPI clock changed");
+
+            SavedState new_state(flash_saved_state);
+
+            for (int i = 0; i < SCREEN_COUNT; i++)
+            {
+                printf("- Screen %d ETag: %s\n", i + 1, etags[i].c_str());
+                new_state.set_etag(i, etags[i].c_str());
+            }
+
+            printf("- SPI clock: %d kHz\n", spi_baudrate / 1000);
+            new_state.spi_baudrate = spi_baudrate;
+            new_state.save();
+
+            printf("State saved to flash, %d total writes.\n", new_state.write_count);
+        }
+
+        // Don't poll faster than before if the server answers right away,
+        // e.g. because it is down or doesn't support waiting. Without the
+        // manifest every screen is checked, which changes nothing while they
+        // are all up to date.
+        uint32_t elapsed_ms = (time_us_32() - wait_start) / 1000;
+
+        if (!updated && elapsed_ms < MIN_POLL_INTERVAL_MS)
+        {
+            printf("Sleeping for %u ms...\n", MIN_POLL_INTERVAL_MS - elapsed_ms);
+            co_await scheduler.sleep(MIN_POLL_INTERVAL_MS - elapsed_ms);
+        }
+
+        auto power = take_power_stats();
+        auto cpu_duty_cycle = (uint64_t)power.cpu_active_us() * 100 / (power.total_us ? power.total_us : 1);
+
+        printf("Power: radio active %d ms, power save %d ms, CPU active %d of %d ms (%d%%)\n",
+               power.radio_active_us / 1000, power.radio_power_save_us / 1000, power.cpu_active_us() / 1000,
+               power.total_us / 1000, (int)cpu_duty_cycle);
+
+        auto heap_allocations = heap_allocations_after_init();
+
+        if (heap_allocations > 0)
+        {
+            printf("WARNING: %d heap allocations since startup\n", heap_allocations);
+        }
+    }
+}
+
 int main()
 {
     stdio_init_all();
@@ -82,6 +307,8 @@ int main()
     printf("Pico SDK version: %s\n", PICO_SDK_VERSION_STRING);
     printf("Device ID: %s\n", unique_board_id.c_str());
 
+    event_log.record(EventType::BOOT, watchdog_caused_reboot());
+
     if (!flash_saved_state->is_valid())
     {
         printf("Flash saved state is invalid, resetting...\n");
@@ -95,72 +322,56 @@ int main()
         SavedState new_state;
         new_state.save();
     }
+    else if (flash_saved_state->is_old_version())
+    {
+        printf("Migrating flash saved state from version %d to %d...\n", flash_saved_state->version, STATE_VERSION);
+        auto new_state = SavedState::migrate(flash_saved_state);
+        new_state.save();
+    }
 
     printf("Saved state version=%d, write count=%d\n", flash_saved_state->version, flash_saved_state->write_count);
 
     setup_wifi();
 
-    SPI spi(spi0, SPI_1MHZ,
-            2, // SCK pin
-            3, // MOSI pin
-            4  // MISO pin
-    );
-
-    Waveshare13K screen1(spi,
-                         1, // Screen ID
-                         9, // Power pin
-                         5, // Chip Select pin
-                         6, // Data/Command pin
-                         7, // Reset pin
-                         8  // Busy pin
-    );
-    std::string etag1 = flash_saved_state->etag1;
-
-    Waveshare13K screen2(spi,
-                         2,  // Screen ID
-                         14, // Power pin
-                         10, // Chip Select pin
-                         11, // Data/Command pin
-                         12, // Reset pin
-                         13  // Busy pin
-    );
-    std::string etag2 = flash_saved_state->etag2;
-
-    Waveshare13K screen3(spi,
-                         3,  // Screen ID
-                         26, // Power pin
-                         19, // Chip Select pin
-                         20, // Data/Command pin
-                         21, // Reset pin
-                         22  // Busy pin
-    );
-    std::string etag3 = flash_saved_state->etag3;
+    multicore_launch_core1(core1_main);
 
-    printf("Screen 1 ETag: %s\n", etag1.c_str());
-    printf("Screen 2 ETag: %s\n", etag2.c_str());
-    printf("Screen 3 ETag: %s\n", etag3.c_str());
+    ETag etags[SCREEN_COUNT];
 
-    while (true)
+    for (int i = 0; i < SCREEN_COUNT; i++)
     {
-        printf("Refreshing screens...\n");
-        bool updated1 = refresh_screen(1, screen1, etag1);
-        bool updated2 = refresh_screen(2, screen2, etag2);
-        bool updated3 = refresh_screen(3, screen3, etag3);
+        etags[i] = flash_saved_state->etags[i];
+        printf("Screen %d ETag: %s\n", i + 1, etags[i].c_str());
+    }
 
-        if (updated1 || updated2 || updated3)
-        {
-            printf("One or more screens updated, saving state...\n");
-            printf("- Screen 1 ETag: %s\n", etag1.c_str());
-            printf("- Screen 2 ETag: %s\n", etag2.c_str());
-            printf("- Screen 3 ETag: %s\n", etag3.c_str());
+    // Frames on screen are never evicted, so a new one needs a slot of its own
+    static_assert(FRAME_CACHE_SLOTS > SCREEN_COUNT);
+    FrameCache frame_cache(etags, SCREEN_COUNT);
 
-            SavedState new_state(flash_saved_state, etag1, etag2, etag3);
-            new_state.save();
+    // Each screen's images go through a CachingSink, which keeps a copy of
+    // them in the frame cache, to a ScreenSink
+    std::array<std::optional<ScreenSink>, SCREEN_COUNT> displays;
+    std::array<std::optional<CachingSink>, SCREEN_COUNT> cached;
+    ImageSink *screens[SCREEN_COUNT];
+    ImageSink *sinks[SCREEN_COUNT];
 
-            printf("State saved to flash, %d total writes.\n", new_state.write_count);
-        }
+    for (int i = 0; i < SCREEN_COUNT; i++)
+    {
+        displays[i].emplace(display_worker, i);
+        cached[i].emplace(*displays[i], frame_cache, etags[i]);
+        screens[i] = &*displays[i];
+        sinks[i] = &*cached[i];
+    }
 
-        printf("Sleeping for 10 seconds...\n");
-        sleep_ms(10000);
+    scheduler.spawn(refresh_loop(frame_cache, etags, screens, sinks));
+    scheduler.spawn(monitor_wifi());
+
+    // Everything from here on runs from fixed buffers and the task frame pool.
+    // Core 1 may still be setting up the displays.
+    while (!display_worker.isRunning())
+    {
+        tight_loop_contents();
     }
+
+    lock_heap();
+    scheduler.run();
 }
@@ -0,0 +1,129 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "packbits.h"
+
+#include <string.h>
+
+void PackBitsDecoder::begin(const ImageRegion &region)
+{
+    state = State::HEADER;
+    remaining = 0;
+    buffer_len = 0;
+    output.begin(region);
+}
+
+void PackBitsDecoder::write(const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+
+    while (i < len)
+    {
+        switch (state)
+        {
+        case State::HEADER: {
+            auto header = (int8_t)data[i++];
+
+            if (header >= 0)
+            {
+                // Copy the next header + 1 bytes literally
+                state = State::LITERAL;
+                remaining = header + 1;
+            }
+            else if (header != -128)
+            {
+                // Repeat the next byte 1 - header times
+                state = State::RUN;
+                remaining = 1 - header;
+            }
+            // -128 is a no-op
+            break;
+        }
+        case State::LITERAL: {
+            auto count = len - i;
+            count = count < remaining ? count : remaining;
+            count = count < buffer.size() - buffer_len ? count : buffer.size() - buffer_len;
+
+            memcpy(buffer.data() + buffer_len, data + i, count);
+            buffer_len += count;
+            remaining -= count;
+            i += count;
+
+            if (remaining == 0)
+            {
+                state = State::HEADER;
+            }
+            break;
+        }
+        case State::RUN: {
+            auto count = remaining < buffer.size() - buffer_len ? remaining : buffer.size() - buffer_len;
+
+            memset(buffer.data() + buffer_len, data[i], count);
+            buffer_len += count;
+            remaining -= count;
+
+            if (remaining == 0)
+            {
+                state = State::HEADER;
+                i++;
+            }
+            break;
+        }
+        }
+
+        if (buffer_len == buffer.size())
+        {
+            flush();
+        }
+    }
+}
+
+size_t PackBitsDecoder::writable() const
+{
+    auto space = output.writable();
+
+    if (space == SIZE_MAX)
+    {
+        return SIZE_MAX;
+    }
+
+    // What is buffered goes out first, and no byte decodes to more than the
+    // longest run
+    constexpr size_t MAX_RUN = 128;
+    return space > buffer_len ? (space - buffer_len) / MAX_RUN : 0;
+}
+
+void PackBitsDecoder::end(bool complete)
+{
+    output.end(finish() && complete);
+}
+
+bool PackBitsDecoder::finish()
+{
+    flush();
+    return state == State::HEADER;
+}
+
+void PackBitsDecoder::flush()
+{
+    if (buffer_len > 0)
+    {
+        output.write(buffer.data(), buffer_len);
+        buffer_len = 0;
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "image_sink.h"
+
+/**
+ * Streaming PackBits decoder.
+ *
+ * Takes PackBits encoded data in chunks of any size and writes the decoded
+ * image to `output`. Runs and literals may be split across chunks; the only
+ * state kept between chunks is the current header and a small output buffer.
+ */
+class PackBitsDecoder : public ImageSink
+{
+  public:
+    PackBitsDecoder(ImageSink &output) : output(output)
+    {
+    }
+
+    void begin(const ImageRegion &region) override;
+    void write(const uint8_t *data, size_t len) override;
+    void end(bool complete) override;
+    size_t writable() const override;
+
+    /**
+     * Flushes any buffered output.
+     *
+     * @return false if the encoded data ended in the middle of a run or literal.
+     */
+    bool finish();
+
+  private:
+    enum class State
+    {
+        HEADER,
+        LITERAL,
+        RUN,
+    };
+
+    void flush();
+
+    ImageSink &output;
+
+    State state = State::HEADER;
+    // Bytes left in the current literal, or repeats left in the current run
+    size_t remaining = 0;
+
+    std::array<uint8_t, 512> buffer;
+    size_t buffer_len = 0;
+};
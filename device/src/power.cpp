@@ -0,0 +1,85 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "power.h"
+
+#include <stdio.h>
+
+#include "pico/cyw43_arch.h"
+
+// Only used from core 0
+static RadioMode radio_mode = RadioMode::ACTIVE;
+static uint32_t radio_mode_since = 0;
+static uint32_t stats_since = 0;
+static PowerStats stats = {};
+
+static void account_radio_time(uint32_t now)
+{
+    auto elapsed = now - radio_mode_since;
+
+    if (radio_mode == RadioMode::ACTIVE)
+    {
+        stats.radio_active_us += elapsed;
+    }
+    else
+    {
+        stats.radio_power_save_us += elapsed;
+    }
+
+    radio_mode_since = now;
+}
+
+void set_radio_mode(RadioMode mode)
+{
+    if (mode == radio_mode)
+    {
+        return;
+    }
+
+    auto pm = mode == RadioMode::ACTIVE ? CYW43_NONE_PM : CYW43_AGGRESSIVE_PM;
+
+    if (cyw43_wifi_pm(&cyw43_state, pm) != 0)
+    {
+        printf("WARNING: Failed to set Wi-Fi power mode\n");
+        return;
+    }
+
+    account_radio_time(time_us_32());
+    radio_mode = mode;
+}
+
+void idle_wait_for_work_ms(async_context_t *context, uint32_t ms)
+{
+    auto start = time_us_32();
+    async_context_wait_for_work_ms(context, ms);
+    stats.cpu_idle_us += time_us_32() - start;
+}
+
+PowerStats take_power_stats()
+{
+    auto now = time_us_32();
+    account_radio_time(now);
+
+    auto result = stats;
+    result.total_us = now - stats_since;
+
+    stats = {};
+    stats_since = now;
+
+    return result;
+}
@@ -0,0 +1,55 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "pico/async_context.h"
+#include "pico/stdlib.h"
+
+enum class RadioMode
+{
+    // Radio always listening, for the fastest transfers
+    ACTIVE,
+    // Radio dozes between the access point's beacons once the connection has
+    // been idle for a while. The access point holds packets for it meanwhile,
+    // so an open connection still gets its data within a beacon interval.
+    POWER_SAVE,
+};
+
+// Time spent in each power state since the last call to take_power_stats()
+struct PowerStats
+{
+    uint32_t total_us;
+    uint32_t radio_active_us;
+    uint32_t radio_power_save_us;
+    // Time core 0 spent asleep waiting for work
+    uint32_t cpu_idle_us;
+
+    uint32_t cpu_active_us() const
+    {
+        return total_us - cpu_idle_us;
+    }
+};
+
+void set_radio_mode(RadioMode mode);
+
+// Sleeps core 0 until there is work for `context` or `ms` have passed,
+// counting the time as idle.
+void idle_wait_for_work_ms(async_context_t *context, uint32_t ms);
+
+PowerStats take_power_stats();
@@ -0,0 +1,91 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "refresh_scheduler.h"
+
+#include "telemetry.h"
+
+void RefreshScheduler::add(Waveshare13K &screen)
+{
+    hard_assert(count < refreshes.size());
+
+    screen.startRefresh();
+    refreshes[count++] = {&screen, time_us_32()};
+}
+
+bool RefreshScheduler::poll()
+{
+    size_t i = 0;
+
+    while (i < count)
+    {
+        auto &refresh = refreshes[i];
+
+        if (refresh.screen->isBusy())
+        {
+            if (time_us_32() - refresh.started_us > Waveshare13K::BUSY_TIMEOUT_MS * 1000)
+            {
+                printf("[%d] Timeout waiting for busy pin to go low\n", refresh.screen->getId());
+                refresh.screen->shutdown();
+                reset_pico(RebootReason::BUSY_TIMEOUT, refresh.screen->getId());
+            }
+
+            i++;
+            continue;
+        }
+
+        auto elapsed_us = refresh.screen->busyTimeUs(refresh.started_us);
+        printf("[%d] --> Refreshed in %d ms\n", refresh.screen->getId(), elapsed_us / 1000);
+        telemetry.record(Phase::BUSY_WAIT, elapsed_us, refresh.screen->getId() - 1);
+        refresh.screen->finishRefresh();
+        refresh.screen->sleep();
+
+        refreshes[i] = refreshes[--count];
+    }
+
+    return count == 0;
+}
+
+void RefreshScheduler::wait()
+{
+    while (!poll())
+    {
+        best_effort_wfe_or_timeout(make_timeout_time_ms(REFRESH_CHECK_INTERVAL_MS));
+    }
+}
+
+void RefreshScheduler::wait(const Waveshare13K &screen)
+{
+    while (!poll() && isRefreshing(screen))
+    {
+        best_effort_wfe_or_timeout(make_timeout_time_ms(REFRESH_CHECK_INTERVAL_MS));
+    }
+}
+
+bool RefreshScheduler::isRefreshing(const Waveshare13K &screen) const
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        if (refreshes[i].screen == &screen)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,68 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "waveshare.h"
+
+// The busy pins' interrupts wake up waits for refreshes, so checking them on a
+// timer only bounds how late a missed edge is noticed
+inline constexpr uint32_t REFRESH_CHECK_INTERVAL_MS = 1000;
+
+/**
+ * Refreshes several displays at once.
+ *
+ * A display is added once a new image has been loaded into its RAM, which
+ * starts its update waveform straight away. Since each display has its own
+ * busy pin, the waveforms run in parallel with each other and with loading
+ * the next display, so refreshing all of them takes about as long as
+ * refreshing one.
+ */
+class RefreshScheduler
+{
+  public:
+    void add(Waveshare13K &screen);
+
+    /**
+     * Puts displays that have finished refreshing back to sleep.
+     *
+     * @return true if no display is refreshing anymore.
+     */
+    bool poll();
+
+    // Waits for all displays to finish refreshing.
+    void wait();
+
+    // Waits for one display to finish refreshing, if it is. Its RAM can't be
+    // loaded with the next image before then.
+    void wait(const Waveshare13K &screen);
+
+  private:
+    bool isRefreshing(const Waveshare13K &screen) const;
+
+    struct Refresh
+    {
+        Waveshare13K *screen;
+        uint32_t started_us;
+    };
+
+    std::array<Refresh, 8> refreshes;
+    size_t count = 0;
+};
@@ -0,0 +1,152 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "scheduler.h"
+
+#include <stdio.h>
+
+#include "pico/async_context.h"
+#include "pico/cyw43_arch.h"
+#include "power.h"
+
+// Only used from core 0
+alignas(max_align_t) static uint8_t task_frames[TASK_FRAME_COUNT][TASK_FRAME_SIZE];
+static bool task_frame_used[TASK_FRAME_COUNT];
+
+void *allocate_task_frame(size_t size)
+{
+    if (size > TASK_FRAME_SIZE)
+    {
+        printf("Task frame of %zu bytes is larger than TASK_FRAME_SIZE\n", size);
+        hard_assert(false);
+    }
+
+    for (int i = 0; i < TASK_FRAME_COUNT; i++)
+    {
+        if (!task_frame_used[i])
+        {
+            task_frame_used[i] = true;
+            return task_frames[i];
+        }
+    }
+
+    printf("All %d task frames are in use\n", TASK_FRAME_COUNT);
+    hard_assert(false);
+    return nullptr;
+}
+
+void free_task_frame(void *frame)
+{
+    auto i = ((uint8_t *)frame - &task_frames[0][0]) / TASK_FRAME_SIZE;
+    task_frame_used[i] = false;
+}
+
+void Scheduler::spawn(Task<void> task)
+{
+    for (auto &slot : tasks)
+    {
+        if (slot.isDone())
+        {
+            addWaiter(task.handle, get_absolute_time(), false);
+            slot = std::move(task);
+            return;
+        }
+    }
+
+    printf("No room for another task\n");
+    hard_assert(false);
+}
+
+void Scheduler::run()
+{
+    auto context = cyw43_arch_async_context();
+
+    while (true)
+    {
+        // Handles network events where lwIP isn't run in the background
+        async_context_poll(context);
+
+        // Tasks that wait again while being resumed wait at least until the
+        // next turn
+        std::array<std::coroutine_handle<>, MAX_WAITERS> due;
+        size_t due_count = 0;
+        auto now = get_absolute_time();
+
+        for (auto &waiter : waiters)
+        {
+            if (waiter.handle && isDue(waiter, now))
+            {
+                due[due_count++] = waiter.handle;
+                waiter.handle = nullptr;
+            }
+        }
+
+        for (size_t i = 0; i < due_count; i++)
+        {
+            due[i].resume();
+        }
+
+        for (auto &task : tasks)
+        {
+            if (task.isDone())
+            {
+                task = {};
+            }
+        }
+
+        // Sleep until the first wait is over, unless one already is
+        now = get_absolute_time();
+        auto next = delayed_by_ms(now, 1000);
+
+        for (auto &waiter : waiters)
+        {
+            if (waiter.handle && absolute_time_diff_us(waiter.deadline, next) > 0)
+            {
+                next = waiter.deadline;
+            }
+        }
+
+        auto wait_us = absolute_time_diff_us(now, next);
+
+        if (wait_us > 0)
+        {
+            idle_wait_for_work_ms(context, (wait_us + 999) / 1000);
+            turn++;
+        }
+    }
+}
+
+void Scheduler::addWaiter(std::coroutine_handle<> handle, absolute_time_t deadline, bool on_work)
+{
+    for (auto &waiter : waiters)
+    {
+        if (!waiter.handle)
+        {
+            waiter = {handle, deadline, on_work, turn};
+            return;
+        }
+    }
+
+    printf("No room for another waiting task\n");
+    hard_assert(false);
+}
+
+bool Scheduler::isDue(const Waiter &waiter, absolute_time_t now) const
+{
+    return absolute_time_diff_us(waiter.deadline, now) >= 0 || (waiter.on_work && waiter.turn != turn);
+}
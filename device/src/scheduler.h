@@ -0,0 +1,98 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <coroutine>
+
+#include "pico/stdlib.h"
+#include "task.h"
+
+/**
+ * Runs tasks on core 0, one at a time, switching between them where they wait.
+ *
+ * While every task is waiting, core 0 sleeps until the network has something
+ * to do or the first wait is over. Only the tasks themselves run in the
+ * foreground; lwIP keeps running in the background as before.
+ */
+class Scheduler
+{
+  public:
+    static constexpr size_t MAX_TASKS = 4;
+    static constexpr size_t MAX_WAITERS = 8;
+
+    // Starts `task` on the next turn, and keeps it until it returns
+    void spawn(Task<void> task);
+
+    [[noreturn]] void run();
+
+    // Resumes the awaiting task after `ms`.
+    auto sleep(uint32_t ms)
+    {
+        return Wait{*this, make_timeout_time_ms(ms), false};
+    }
+
+    // Resumes the awaiting task once the network may have work for it, or
+    // after `ms`. The task has to check for itself what happened.
+    auto waitForWork(uint32_t ms)
+    {
+        return Wait{*this, make_timeout_time_ms(ms), true};
+    }
+
+  private:
+    struct Wait
+    {
+        Scheduler &scheduler;
+        absolute_time_t deadline;
+        bool on_work;
+
+        bool await_ready() const
+        {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle)
+        {
+            scheduler.addWaiter(handle, deadline, on_work);
+        }
+
+        void await_resume()
+        {
+        }
+    };
+
+    struct Waiter
+    {
+        std::coroutine_handle<> handle;
+        absolute_time_t deadline;
+        bool on_work;
+        // Turn the wait started in
+        uint32_t turn;
+    };
+
+    void addWaiter(std::coroutine_handle<> handle, absolute_time_t deadline, bool on_work);
+    bool isDue(const Waiter &waiter, absolute_time_t now) const;
+
+    std::array<Task<void>, MAX_TASKS> tasks;
+    std::array<Waiter, MAX_WAITERS> waiters = {};
+    // Counts the sleeps of core 0
+    uint32_t turn = 0;
+};
+
+inline Scheduler scheduler;
@@ -0,0 +1,46 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <iterator>
+
+#include "image_sink.h"
+#include "pico/stdlib.h"
+
+// Pins of a display, besides the SPI bus they all share
+struct ScreenPins
+{
+    uint power;
+    uint cs;
+    uint dc;
+    uint reset;
+    uint busy;
+};
+
+// The displays on the board. Image N on the server is shown on SCREENS[N - 1].
+// More panels go on extra chip select lines.
+inline constexpr ScreenPins SCREENS[] = {
+    {9, 5, 6, 7, 8},
+    {14, 10, 11, 12, 13},
+    {26, 19, 20, 21, 22},
+};
+
+inline constexpr int SCREEN_COUNT = std::size(SCREENS);
+
+static_assert(SCREEN_COUNT <= MAX_SCREENS, "A saved state only has room for MAX_SCREENS ETags");
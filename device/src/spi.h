@@ -18,11 +18,21 @@
 
 #pragma once
 
+#include "hardware/dma.h"
 #include "hardware/gpio.h"
+#include "hardware/irq.h"
 #include "hardware/spi.h"
 #include "pico/stdlib.h"
 
 constexpr uint SPI_1MHZ = 1000 * 1000;
+// Reads from the panel controllers are only specified for slower clocks than
+// writes, so they always use this rate
+constexpr uint SPI_READ_BAUDRATE = SPI_1MHZ;
+
+// Called from the DMA interrupt once an async write has fully left the SPI
+// peripheral, so it must be short. It still holds the bus, and may go on with
+// `SPI::writeFromCallback()` and `SPI::continueAsync()`.
+typedef void (*spi_write_done_fn)(void *arg);
 
 // For more examples of SPI use see
 // https://github.com/raspberrypi/pico-examples/tree/master/spi
@@ -35,6 +45,39 @@ class SPI
         gpio_set_function(pin_sck, GPIO_FUNC_SPI);
         gpio_set_function(pin_mosi, GPIO_FUNC_SPI);
         gpio_set_function(pin_miso, GPIO_FUNC_SPI);
+
+        dma_channel = dma_claim_unused_channel(true);
+        instances[dma_channel] = this;
+
+        dma_channel_config config = dma_channel_get_default_config(dma_channel);
+        channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+        channel_config_set_read_increment(&config, true);
+        channel_config_set_write_increment(&config, false);
+        channel_config_set_dreq(&config, spi_get_dreq(spi, true));
+        dma_channel_configure(dma_channel, &config, &spi_get_hw(spi)->dr, nullptr, 0, false);
+
+        // DMA_IRQ_0 is left to the CYW43 driver
+        dma_channel_set_irq1_enabled(dma_channel, true);
+        irq_add_shared_handler(DMA_IRQ_1, on_dma_irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+        irq_set_enabled(DMA_IRQ_1, true);
+    }
+
+    // Returns the rate actually set, which the clock divider may round down
+    uint setBaudrate(uint baudrate)
+    {
+        waitForWrite();
+        return spi_set_baudrate(spi, baudrate);
+    }
+
+    uint getBaudrate() const
+    {
+        return spi_get_baudrate(spi);
+    }
+
+    void read(uint8_t *data, size_t len)
+    {
+        waitForWrite();
+        spi_read_blocking(spi, 0x00, data, len);
     }
 
     void write(uint8_t byte)
@@ -43,10 +86,128 @@ class SPI
     }
 
     void write(const uint8_t *data, size_t len)
+    {
+        waitForWrite();
+        spi_write_blocking(spi, data, len);
+    }
+
+    /**
+     * Starts writing `data` in the background using DMA and returns immediately.
+     *
+     * The buffer must stay valid until the write is done. Any chip select or
+     * data/command lines must be held by the caller until `callback` runs.
+     */
+    void writeAsync(const uint8_t *data, size_t len, spi_write_done_fn callback = nullptr, void *arg = nullptr)
+    {
+        waitForWrite();
+
+        if (len == 0)
+        {
+            if (callback)
+            {
+                callback(arg);
+            }
+            return;
+        }
+
+        write_done_fn = callback;
+        write_done_arg = arg;
+        writing = true;
+
+        dma_channel_transfer_from_buffer_now(dma_channel, data, len);
+    }
+
+    /**
+     * Writes `data` from the callback of an async write, which holds the bus
+     * until it returns. Blocks, so only for a few bytes.
+     */
+    void writeFromCallback(const uint8_t *data, size_t len)
     {
         spi_write_blocking(spi, data, len);
     }
 
+    /**
+     * Starts another async write from the callback of one, so the bus stays
+     * held until this one is done as well.
+     */
+    void continueAsync(const uint8_t *data, size_t len, spi_write_done_fn callback = nullptr, void *arg = nullptr)
+    {
+        hard_assert(len > 0);
+
+        write_done_fn = callback;
+        write_done_arg = arg;
+        continued = true;
+
+        dma_channel_transfer_from_buffer_now(dma_channel, data, len);
+    }
+
+    bool isWriting() const
+    {
+        return writing;
+    }
+
+    void waitForWrite()
+    {
+        while (writing)
+        {
+            tight_loop_contents();
+        }
+    }
+
   private:
+    static void on_dma_irq()
+    {
+        for (auto instance : instances)
+        {
+            if (instance && dma_channel_get_irq1_status(instance->dma_channel))
+            {
+                dma_channel_acknowledge_irq1(instance->dma_channel);
+                instance->finishWrite();
+            }
+        }
+    }
+
+    void finishWrite()
+    {
+        // The DMA is done once the last byte is in the TX FIFO, but it still has
+        // to be clocked out before the caller can release chip select.
+        while (spi_is_busy(spi))
+        {
+            tight_loop_contents();
+        }
+
+        // Drop whatever was clocked in on MISO so later reads start clean
+        while (spi_is_readable(spi))
+        {
+            (void)spi_get_hw(spi)->dr;
+        }
+        spi_get_hw(spi)->icr = SPI_SSPICR_RORIC_BITS;
+
+        auto callback = write_done_fn;
+        auto arg = write_done_arg;
+        write_done_fn = nullptr;
+        write_done_arg = nullptr;
+        continued = false;
+
+        if (callback)
+        {
+            callback(arg);
+        }
+
+        // The bus is only free if the callback didn't start another write
+        if (!continued)
+        {
+            writing = false;
+        }
+    }
+
+    inline static SPI *instances[NUM_DMA_CHANNELS] = {};
+
     spi_inst_t *spi;
+    uint dma_channel;
+    volatile bool writing = false;
+    // Whether the callback of the write that finished started another one
+    bool continued = false;
+    spi_write_done_fn write_done_fn = nullptr;
+    void *write_done_arg = nullptr;
 };
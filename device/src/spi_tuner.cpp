@@ -0,0 +1,137 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "spi_tuner.h"
+
+#include <stdio.h>
+
+// Rates tried in order. Above 1 MHz they are ones the SPI clock divider makes
+// exactly from the 125 MHz peripheral clock, up to its limit of a quarter.
+constexpr uint PERIPHERAL_CLOCK = 125 * 1000 * 1000;
+
+static constexpr uint SPI_BAUDRATES[] = {
+    SPI_1MHZ,             PERIPHERAL_CLOCK / 62, PERIPHERAL_CLOCK / 32, PERIPHERAL_CLOCK / 16, PERIPHERAL_CLOCK / 12,
+    PERIPHERAL_CLOCK / 10, PERIPHERAL_CLOCK / 8, PERIPHERAL_CLOCK / 6,  PERIPHERAL_CLOCK / 4,
+};
+
+// Patterns written at each rate, each a couple of rows long
+constexpr int TEST_PATTERNS = 3;
+constexpr size_t TEST_SIZE = 2 * Waveshare13K::ROW_BYTES;
+
+// Only used by core 1
+static uint8_t test_pattern[TEST_SIZE];
+
+uint SpiTuner::tune(uint saved_baudrate)
+{
+    auto start = time_us_32();
+
+    for (size_t i = 0; i < count; i++)
+    {
+        screens[i]->init();
+    }
+
+    if (saved_baudrate > 0 && test(saved_baudrate))
+    {
+        baudrate = saved_baudrate;
+        printf("SPI clock of %d kHz still works\n", baudrate / 1000);
+    }
+    else
+    {
+        baudrate = calibrate();
+        printf("SPI clock calibrated to %d kHz\n", baudrate / 1000);
+    }
+
+    for (size_t i = 0; i < count; i++)
+    {
+        screens[i]->shutdown();
+    }
+
+    spi.setBaudrate(baudrate);
+    printf("SPI tuning took %d ms\n", (time_us_32() - start) / 1000);
+
+    return baudrate;
+}
+
+uint SpiTuner::fallBack()
+{
+    uint slower = SPI_BAUDRATES[0];
+
+    for (auto candidate : SPI_BAUDRATES)
+    {
+        if (candidate < baudrate)
+        {
+            slower = candidate;
+        }
+    }
+
+    baudrate = spi.setBaudrate(slower);
+    printf("Lowered the SPI clock to %d kHz\n", baudrate / 1000);
+
+    return baudrate;
+}
+
+// Goes up until a rate fails, since anything faster is unlikely to work
+uint SpiTuner::calibrate()
+{
+    uint best = SPI_BAUDRATES[0];
+
+    for (auto candidate : SPI_BAUDRATES)
+    {
+        if (!test(candidate))
+        {
+            printf("- %d kHz failed\n", spi.getBaudrate() / 1000);
+            break;
+        }
+
+        best = spi.getBaudrate();
+        printf("- %d kHz works\n", best / 1000);
+    }
+
+    return best;
+}
+
+bool SpiTuner::test(uint baudrate)
+{
+    auto actual = spi.setBaudrate(baudrate);
+
+    for (int pattern = 0; pattern < TEST_PATTERNS; pattern++)
+    {
+        // xorshift32, so every run with a rate writes the same data
+        uint32_t state = actual + pattern * 0x9E3779B9;
+
+        for (auto &byte : test_pattern)
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            byte = state;
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            screens[i]->writeRam(Waveshare13K::PREVIOUS_RAM, 0, test_pattern, TEST_SIZE);
+
+            if (!screens[i]->verifyRam(Waveshare13K::PREVIOUS_RAM, 0, test_pattern, TEST_SIZE))
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
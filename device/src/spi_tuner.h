@@ -0,0 +1,61 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "spi.h"
+#include "waveshare.h"
+
+/**
+ * Finds the fastest SPI clock that all displays on the bus reliably take.
+ *
+ * A rate is tested by writing patterns into each display's RAM and reading
+ * them back at SPI_READ_BAUDRATE. Runs on core 1 while the displays are off
+ * anyway after a reboot, since it overwrites their RAM.
+ */
+class SpiTuner
+{
+  public:
+    SpiTuner(SPI &spi, Waveshare13K *const *screens, size_t count) : spi(spi), screens(screens), count(count)
+    {
+    }
+
+    /**
+     * Sets the bus to `saved_baudrate` if it still passes the test, and
+     * otherwise to the fastest rate that does. Pass 0 if no rate was saved.
+     * Returns the rate set.
+     */
+    uint tune(uint saved_baudrate);
+
+    // Steps down to the next slower rate after an error, returning it
+    uint fallBack();
+
+    uint getBaudrate() const
+    {
+        return baudrate;
+    }
+
+  private:
+    uint calibrate();
+    bool test(uint baudrate);
+
+    SPI &spi;
+    Waveshare13K *const *screens;
+    const size_t count;
+    uint baudrate = SPI_1MHZ;
+};
@@ -0,0 +1,80 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <stddef.h>
+
+/**
+ * Lock-free queue for passing items from one core to the other.
+ *
+ * Exactly one core may push and exactly one core may pop. Holds up to N - 1
+ * items.
+ */
+template <typename T, size_t N> class SpscQueue
+{
+  public:
+    bool push(const T &item)
+    {
+        auto tail = this->tail.load(std::memory_order_relaxed);
+        auto next = (tail + 1) % N;
+
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        items[tail] = item;
+        this->tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        auto head = this->head.load(std::memory_order_relaxed);
+
+        if (head == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = items[head];
+        this->head.store((head + 1) % N, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    // Items that can be pushed before the queue is full. Only the pushing
+    // core may rely on it.
+    size_t space() const
+    {
+        auto used = (tail.load(std::memory_order_relaxed) + N - head.load(std::memory_order_acquire)) % N;
+        return N - 1 - used;
+    }
+
+  private:
+    std::array<T, N> items;
+    std::atomic<size_t> head = 0;
+    std::atomic<size_t> tail = 0;
+};
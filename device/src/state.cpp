@@ -21,52 +21,208 @@
 #include "hardware/flash.h"
 #include "hardware/sync.h"
 #include "pico/flash.h"
+#include "telemetry.h"
 #include "utils.h"
-#include <functional>
+#include <stddef.h>
 #include <string.h>
 
-constexpr auto FLASH_TARGET_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
+constexpr uint32_t STATE_LOG_PAGES = STATE_LOG_SIZE / FLASH_PAGE_SIZE;
+constexpr uint32_t PAGES_PER_SECTOR = FLASH_SECTOR_SIZE / FLASH_PAGE_SIZE;
 
-const SavedState *flash_saved_state = (const SavedState *)(XIP_BASE + FLASH_TARGET_OFFSET);
+// Before the log, a single state was kept at the start of the last sector
+constexpr uint32_t LEGACY_STATE_OFFSET = PICO_FLASH_SIZE_BYTES - FLASH_SECTOR_SIZE;
 
-int flash_safe_execute(std::function<void()> func, uint32_t enter_exit_timeout_ms)
+constexpr uint32_t STATE_RECORD_MAGIC = 0x5354474C; // "LGTS"
+
+static_assert(STATE_LOG_SECTORS >= 2, "The newest state must survive erasing the sector after it");
+
+// Layout of versions 1 to 3, with an ETag for each of three screens. Version 1
+// ends before wifi_network and version 2 before spi_baudrate.
+struct SavedStateV3
 {
-    return flash_safe_execute(
-        [](void *arg) {
-            auto func = static_cast<std::function<void()> *>(arg);
-            (*func)();
-        },
-        &func, enter_exit_timeout_ms);
+    uint64_t magic;
+    uint16_t version;
+    int write_count;
+    char etag1[41];
+    char etag2[41];
+    char etag3[41];
+    WiFiNetwork wifi_network;
+    uint32_t spi_baudrate;
+};
+
+static_assert(offsetof(SavedStateV3, write_count) == offsetof(SavedState, write_count));
+static_assert(MAX_SCREENS >= 3, "Version 3 states hold three ETags");
+
+// One page of the log. Pages that were cut off while being programmed fail
+// the CRC and are skipped. Records of older versions hold a state of their
+// own layout, and version 1 the shortest.
+struct StateRecord
+{
+    uint32_t magic;
+    uint32_t crc;
+    // Increases with every save, so the newest record wins after wrapping
+    uint32_t sequence;
+    uint32_t length;
+    SavedState state;
+
+    uint32_t compute_crc() const
+    {
+        return crc32(&sequence, offsetof(StateRecord, state) - offsetof(StateRecord, sequence) + length);
+    }
+
+    bool is_valid() const
+    {
+        return magic == STATE_RECORD_MAGIC && length >= offsetof(SavedStateV3, wifi_network) &&
+               length <= sizeof(SavedState) && crc == compute_crc();
+    }
+};
+
+static_assert(sizeof(StateRecord) <= FLASH_PAGE_SIZE);
+
+const StateRecord *state_record(uint32_t page)
+{
+    return (const StateRecord *)(XIP_BASE + STATE_LOG_OFFSET + page * FLASH_PAGE_SIZE);
+}
+
+bool is_page_erased(uint32_t page)
+{
+    auto words = (const uint32_t *)state_record(page);
+
+    for (size_t i = 0; i < FLASH_PAGE_SIZE / sizeof(uint32_t); i++)
+    {
+        if (words[i] != 0xFFFFFFFF)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Page holding the newest record, or -1 if the log is empty
+int newest_page = -1;
+uint32_t newest_sequence = 0;
+
+const SavedState *find_saved_state()
+{
+    for (uint32_t page = 0; page < STATE_LOG_PAGES; page++)
+    {
+        auto record = state_record(page);
+
+        if (record->is_valid() && (newest_page < 0 || (int32_t)(record->sequence - newest_sequence) > 0))
+        {
+            newest_page = page;
+            newest_sequence = record->sequence;
+        }
+    }
+
+    if (newest_page >= 0)
+    {
+        return &state_record(newest_page)->state;
+    }
+
+    // Nothing saved since the log was introduced, so fall back to the old
+    // location. Its magic and version are checked like any other state.
+    return (const SavedState *)(XIP_BASE + LEGACY_STATE_OFFSET);
+}
+
+const SavedState *flash_saved_state = find_saved_state();
+
+SavedState::SavedState(const SavedState *prev_state) : SavedState(*prev_state)
+{
+    hard_assert(!prev_state->is_old_version());
+    write_count = prev_state->write_count + 1;
 }
 
-SavedState::SavedState(const SavedState *prev_state, std::string etag1, std::string etag2, std::string etag3)
-    : write_count(prev_state->write_count + 1)
+SavedState SavedState::migrate(const SavedState *old_state)
 {
-    hard_assert(etag1.length() <= 40);
-    hard_assert(etag2.length() <= 40);
-    hard_assert(etag3.length() <= 40);
+    auto old = (const SavedStateV3 *)old_state;
+    hard_assert(old->version >= 1 && old->version <= 3);
+
+    SavedState state;
+    state.write_count = old->write_count + 1;
+    state.set_etag(0, old->etag1);
+    state.set_etag(1, old->etag2);
+    state.set_etag(2, old->etag3);
+
+    if (old->version >= 2)
+    {
+        state.wifi_network = old->wifi_network;
+    }
+
+    if (old->version >= 3)
+    {
+        state.spi_baudrate = old->spi_baudrate;
+    }
 
-    strcpy(this->etag1, etag1.c_str());
-    strcpy(this->etag2, etag2.c_str());
-    strcpy(this->etag3, etag3.c_str());
+    return state;
+}
+
+void SavedState::set_etag(size_t screen, const char *etag)
+{
+    hard_assert(screen < MAX_SCREENS);
+    hard_assert(strlen(etag) <= 40);
+
+    strcpy(etags[screen], etag);
+}
+
+bool WiFiNetwork::operator==(const WiFiNetwork &other) const
+{
+    return strcmp(ssid, other.ssid) == 0 && memcmp(bssid, other.bssid, sizeof(bssid)) == 0 &&
+           channel == other.channel && auth == other.auth;
 }
 
 void SavedState::save()
 {
-    uint8_t page_buf[FLASH_PAGE_SIZE];
+    auto start = time_us_32();
+    uint32_t page = newest_page < 0 ? 0 : (newest_page + 1) % STATE_LOG_PAGES;
+
+    // Skip pages left behind by a save that was cut off. A new sector is
+    // always erased first, which drops its oldest records.
+    while (page % PAGES_PER_SECTOR != 0 && !is_page_erased(page))
+    {
+        page = (page + 1) % STATE_LOG_PAGES;
+    }
+
+    alignas(StateRecord) uint8_t page_buf[FLASH_PAGE_SIZE];
+    memset(page_buf, 0xFF, sizeof(page_buf));
 
-    memcpy(page_buf, this, sizeof(SavedState));
+    auto record = (StateRecord *)page_buf;
+    record->magic = STATE_RECORD_MAGIC;
+    record->sequence = newest_sequence + 1;
+    record->length = sizeof(SavedState);
+    memcpy(&record->state, this, sizeof(SavedState));
+    record->crc = record->compute_crc();
+
+    auto offset = STATE_LOG_OFFSET + page * FLASH_PAGE_SIZE;
+    bool erase_sector = page % PAGES_PER_SECTOR == 0;
 
     int res = flash_safe_execute(
-        [page_buf]() {
-            flash_range_erase(FLASH_TARGET_OFFSET, FLASH_SECTOR_SIZE);
-            flash_range_program(FLASH_TARGET_OFFSET, page_buf, FLASH_PAGE_SIZE);
+        [&]() {
+            if (erase_sector)
+            {
+                flash_range_erase(offset, FLASH_SECTOR_SIZE);
+            }
+
+            flash_range_program(offset, page_buf, FLASH_PAGE_SIZE);
         },
         10000);
 
     if (res != PICO_OK)
     {
         printf("Failed to save state: %d\n", res);
-        reset_pico();
+        reset_pico(RebootReason::STATE_SAVE_FAILED, -res);
     }
+
+    if (!state_record(page)->is_valid())
+    {
+        printf("Saved state failed verification at page %d\n", page);
+        reset_pico(RebootReason::STATE_SAVE_FAILED);
+    }
+
+    newest_page = page;
+    newest_sequence = record->sequence;
+    flash_saved_state = &state_record(page)->state;
+
+    telemetry.record(Phase::FLASH_SAVE, time_us_32() - start);
 }
@@ -19,29 +19,61 @@
 #pragma once
 
 #include <cstdint>
-#include <string>
+
+#include "hardware/flash.h"
+#include "image_sink.h"
 
 inline constexpr auto SAVED_STATE_MAGIC = 0x0123456789ABCDEF;
-inline constexpr uint16_t STATE_VERSION = 1;
+// Version 2 added the Wi-Fi network, version 3 the SPI clock and version 4
+// replaced the three ETags with one per screen. Older states are migrated at
+// startup, with the fields they lack treated as unset.
+inline constexpr uint16_t STATE_VERSION = 4;
+
+// Number of sectors at the end of flash that saved states are appended to.
+// Each save programs a single page, and a sector is only erased once the log
+// wraps around to it.
+#ifndef STATE_LOG_SECTORS
+#define STATE_LOG_SECTORS 4
+#endif
+
+inline constexpr uint32_t STATE_LOG_SIZE = STATE_LOG_SECTORS * FLASH_SECTOR_SIZE;
+inline constexpr uint32_t STATE_LOG_OFFSET = PICO_FLASH_SIZE_BYTES - STATE_LOG_SIZE;
+
+// Network the device last joined, so it can join again without a scan
+struct WiFiNetwork
+{
+    char ssid[33]; // 32 + 1 for null terminator
+    uint8_t bssid[6];
+    uint16_t channel;
+    uint32_t auth;
 
-// Example Etag: 2e16e58b5d7ca51f8e5972e3de922816bab545bf
+    bool operator==(const WiFiNetwork &other) const;
+};
+
+// Every version starts with magic, version and write_count, so any of them
+// can be told apart before it is migrated
 struct SavedState
 {
     uint64_t magic = SAVED_STATE_MAGIC;
     uint16_t version = STATE_VERSION;
     int write_count = 0;
-    char etag1[41]; // 40 + 1 for null terminator
-    char etag2[41]; // 40 + 1 for null terminator
-    char etag3[41]; // 40 + 1 for null terminator
+    WiFiNetwork wifi_network = {};
+    // SPI clock the displays were last driven at, or 0
+    uint32_t spi_baudrate = 0;
+    // By screen, e.g. 2e16e58b5d7ca51f8e5972e3de922816bab545bf
+    char etags[MAX_SCREENS][41] = {}; // 40 + 1 for null terminator
 
     SavedState() : write_count(1)
     {
-        etag1[0] = '\0';
-        etag2[0] = '\0';
-        etag3[0] = '\0';
     }
 
-    SavedState(const SavedState *prev_state, std::string etag1, std::string etag2, std::string etag3);
+    // A copy of `prev_state` to change and save in its place
+    SavedState(const SavedState *prev_state);
+
+    // Converts a state saved before STATE_VERSION, in the layout it had then
+    static SavedState migrate(const SavedState *old_state);
+
+    void set_etag(size_t screen, const char *etag);
 
     void save();
 
@@ -52,7 +84,22 @@ struct SavedState
 
     bool is_wrong_version() const
     {
-        return version != STATE_VERSION;
+        return version == 0 || version > STATE_VERSION;
+    }
+
+    bool is_old_version() const
+    {
+        return version < STATE_VERSION;
+    }
+
+    bool has_wifi_network() const
+    {
+        return wifi_network.ssid[0] != '\0';
+    }
+
+    uint32_t saved_spi_baudrate() const
+    {
+        return spi_baudrate;
     }
 
     static SavedState initial()
@@ -61,4 +108,5 @@ struct SavedState
     }
 };
 
+// Newest saved state in flash, updated by SavedState::save()
 extern const SavedState *flash_saved_state;
@@ -0,0 +1,204 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <coroutine>
+#include <stddef.h>
+#include <type_traits>
+#include <utility>
+
+#include "pico/stdlib.h"
+
+// Coroutine frames come from a fixed pool instead of the heap. The pool needs
+// a frame for each task that is running or waiting for another one.
+#ifndef TASK_FRAME_COUNT
+#define TASK_FRAME_COUNT 8
+#endif
+
+#ifndef TASK_FRAME_SIZE
+#define TASK_FRAME_SIZE 1024
+#endif
+
+void *allocate_task_frame(size_t size);
+void free_task_frame(void *frame);
+
+template <typename T> class Task;
+
+class TaskPromiseBase
+{
+  public:
+    static void *operator new(size_t size)
+    {
+        return allocate_task_frame(size);
+    }
+
+    static void operator delete(void *frame)
+    {
+        free_task_frame(frame);
+    }
+
+    // Tasks only start running once they are awaited or spawned
+    std::suspend_always initial_suspend() noexcept
+    {
+        return {};
+    }
+
+    // Continues with the task that awaited this one, if any
+    struct FinalAwaiter
+    {
+        bool await_ready() noexcept
+        {
+            return false;
+        }
+
+        template <typename Promise>
+        std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+        {
+            auto continuation = handle.promise().continuation;
+            return continuation ? continuation : std::noop_coroutine();
+        }
+
+        void await_resume() noexcept
+        {
+        }
+    };
+
+    FinalAwaiter final_suspend() noexcept
+    {
+        return {};
+    }
+
+    // Exceptions are disabled
+    void unhandled_exception()
+    {
+        hard_assert(false);
+    }
+
+    std::coroutine_handle<> continuation;
+};
+
+template <typename T> class TaskPromise : public TaskPromiseBase
+{
+  public:
+    Task<T> get_return_object();
+
+    void return_value(T value)
+    {
+        this->value = std::move(value);
+    }
+
+    T value;
+};
+
+template <> class TaskPromise<void> : public TaskPromiseBase
+{
+  public:
+    Task<void> get_return_object();
+
+    void return_void()
+    {
+    }
+};
+
+/**
+ * A coroutine run by the Scheduler, see scheduler.h.
+ *
+ * A task starts when another task awaits it, which resumes once the task has
+ * returned, or when it is spawned on the scheduler. Destroying a task that
+ * hasn't finished stops it.
+ */
+template <typename T = void> class Task
+{
+  public:
+    typedef TaskPromise<T> promise_type;
+
+    Task() = default;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle)
+    {
+    }
+
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr))
+    {
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+        if (this != &other)
+        {
+            reset();
+            handle = std::exchange(other.handle, nullptr);
+        }
+
+        return *this;
+    }
+
+    ~Task()
+    {
+        reset();
+    }
+
+    bool isDone() const
+    {
+        return !handle || handle.done();
+    }
+
+    bool await_ready() const
+    {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller)
+    {
+        handle.promise().continuation = caller;
+        return handle;
+    }
+
+    T await_resume()
+    {
+        if constexpr (!std::is_void_v<T>)
+        {
+            return std::move(handle.promise().value);
+        }
+    }
+
+  private:
+    friend class Scheduler;
+
+    void reset()
+    {
+        if (handle)
+        {
+            handle.destroy();
+            handle = nullptr;
+        }
+    }
+
+    std::coroutine_handle<promise_type> handle;
+};
+
+template <typename T> Task<T> TaskPromise<T>::get_return_object()
+{
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object()
+{
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
@@ -0,0 +1,157 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "event_log.h"
+
+static constexpr const char *PHASE_NAMES[] = {"wifi", "dns", "tcp", "ttfb", "body", "flash", "spi", "busy"};
+static_assert(sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]) == (size_t)Phase::COUNT);
+
+Telemetry::Telemetry()
+{
+    critical_section_init(&lock);
+}
+
+void Telemetry::record(Phase phase, uint32_t duration_us, int screen)
+{
+    event_log.record(EventType::PHASE, (uint8_t)phase + 16 * screen, duration_us / 1000);
+
+    size_t bucket = 0;
+
+    for (uint32_t bound_ms = 1; bucket < BUCKETS - 1 && duration_us >= bound_ms * 1000; bound_ms *= 4)
+    {
+        bucket++;
+    }
+
+    critical_section_enter_blocking(&lock);
+
+    auto &stats = sets[active][series(phase, screen)];
+
+    if (stats.count == 0 || duration_us < stats.min_us)
+    {
+        stats.min_us = duration_us;
+    }
+
+    if (duration_us > stats.max_us)
+    {
+        stats.max_us = duration_us;
+    }
+
+    stats.count++;
+    stats.total_us += duration_us;
+
+    if (stats.histogram[bucket] < UINT16_MAX)
+    {
+        stats.histogram[bucket]++;
+    }
+
+    critical_section_exit(&lock);
+}
+
+size_t Telemetry::takeSummary(char *buffer, size_t size)
+{
+    critical_section_enter_blocking(&lock);
+    auto &set = sets[active];
+    active = 1 - active;
+    critical_section_exit(&lock);
+
+    size_t len = 0;
+
+    if (size > 0)
+    {
+        buffer[0] = '\0';
+    }
+
+    for (size_t i = 0; i < SERIES_COUNT; i++)
+    {
+        if (set[i].count > 0)
+        {
+            len += formatSeries(buffer + len, size - len, i, set[i]);
+        }
+    }
+
+    set = {};
+
+    // Drop the separator after the last phase
+    if (len > 0)
+    {
+        buffer[--len] = '\0';
+    }
+
+    return len;
+}
+
+size_t Telemetry::series(Phase phase, int screen)
+{
+    if (phase < Phase::SPI_PUSH)
+    {
+        return (size_t)phase;
+    }
+
+    hard_assert(screen >= 0 && (size_t)screen < MAX_SCREENS);
+
+    return (size_t)Phase::SPI_PUSH + ((size_t)phase - (size_t)Phase::SPI_PUSH) * MAX_SCREENS + screen;
+}
+
+size_t Telemetry::formatSeries(char *buffer, size_t size, size_t series, const Stats &stats)
+{
+    char entry[96];
+    int len;
+
+    if (series < (size_t)Phase::SPI_PUSH)
+    {
+        len = snprintf(entry, sizeof(entry), "%s=", PHASE_NAMES[series]);
+    }
+    else
+    {
+        auto index = series - (size_t)Phase::SPI_PUSH;
+        len = snprintf(entry, sizeof(entry), "%s%d=", PHASE_NAMES[(size_t)Phase::SPI_PUSH + index / MAX_SCREENS],
+                       (int)(index % MAX_SCREENS) + 1);
+    }
+
+    len += snprintf(entry + len, sizeof(entry) - len, "%u,%u,%u,%u,", (unsigned int)stats.count,
+                    (unsigned int)(stats.min_us / 1000), (unsigned int)(stats.total_us / stats.count / 1000),
+                    (unsigned int)(stats.max_us / 1000));
+
+    // Leave out the empty buckets at the end
+    size_t buckets = BUCKETS;
+
+    while (buckets > 1 && stats.histogram[buckets - 1] == 0)
+    {
+        buckets--;
+    }
+
+    for (size_t i = 0; i < buckets; i++)
+    {
+        len += snprintf(entry + len, sizeof(entry) - len, "%s%u", i > 0 ? "." : "", stats.histogram[i]);
+    }
+
+    len += snprintf(entry + len, sizeof(entry) - len, ";");
+
+    if ((size_t)len >= size)
+    {
+        return 0;
+    }
+
+    memcpy(buffer, entry, len + 1);
+    return len;
+}
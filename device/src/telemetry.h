@@ -0,0 +1,98 @@
+/*
+ * eHymnBoard device firmware
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <array>
+
+#include "image_sink.h"
+#include "pico/critical_section.h"
+#include "pico/stdlib.h"
+
+// Timed parts of a refresh cycle. The display phases are kept per screen.
+enum class Phase
+{
+    WIFI_CONNECT,
+    DNS,
+    TCP_CONNECT,
+    // From sending a request to the first byte of its response
+    FIRST_BYTE,
+    // From the first to the last byte of a response
+    BODY,
+    FLASH_SAVE,
+    // Writing an image into the display RAM
+    SPI_PUSH,
+    // Waiting for the display to finish refreshing
+    BUSY_WAIT,
+    COUNT,
+};
+
+/**
+ * Keeps min/avg/max and a histogram of how long each phase took, and formats
+ * them as a compact summary that is sent to the server with the next manifest
+ * request.
+ *
+ * Both cores record phases. Each summary covers the time since the previous
+ * one: recording goes to one set of stats while the other is summarized.
+ */
+class Telemetry
+{
+  public:
+    // Buckets hold durations below 1, 4, 16, ... ms, the last one the rest
+    static constexpr size_t BUCKETS = 8;
+
+    Telemetry();
+
+    // `screen` is only used for the display phases
+    void record(Phase phase, uint32_t duration_us, int screen = 0);
+
+    /**
+     * Formats everything recorded since the last call, as
+     * "<phase>=<count>,<min>,<avg>,<max>,<histogram>;..." with times in ms and
+     * the bucket counts separated by dots. Phases that don't fit are dropped.
+     *
+     * @return The length of the summary, 0 if nothing was recorded.
+     */
+    size_t takeSummary(char *buffer, size_t size);
+
+  private:
+    struct Stats
+    {
+        uint32_t count;
+        uint32_t min_us;
+        uint32_t max_us;
+        uint64_t total_us;
+        std::array<uint16_t, BUCKETS> histogram;
+    };
+
+    // Phases before SPI_PUSH have one series, the display phases one per screen
+    static constexpr size_t SERIES_COUNT =
+        (size_t)Phase::SPI_PUSH + ((size_t)Phase::COUNT - (size_t)Phase::SPI_PUSH) * MAX_SCREENS;
+
+    typedef std::array<Stats, SERIES_COUNT> StatsSet;
+
+    static size_t series(Phase phase, int screen);
+    static size_t formatSeries(char *buffer, size_t size, size_t series, const Stats &stats);
+
+    critical_section_t lock;
+    std::array<StatsSet, 2> sets = {};
+    // Set being recorded to, the other one is only used by takeSummary()
+    int active = 0;
+};
+
+inline Telemetry telemetry;
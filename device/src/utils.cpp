@@ -18,6 +18,7 @@
 
 #include "utils.h"
 
+#include "hardware/dma.h"
 #include "pico/unique_id.h"
 
 std::string get_unique_board_id()
@@ -29,8 +30,66 @@ std::string get_unique_board_id()
     return std::string(buf);
 }
 
-void reset_pico()
+uint32_t crc32(const void *data, size_t len, uint32_t crc)
 {
+    auto bytes = (const uint8_t *)data;
+    crc = ~crc;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        crc ^= bytes[i];
+
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+static uint32_t reverse_bits(uint32_t value)
+{
+    value = ((value >> 1) & 0x55555555) | ((value & 0x55555555) << 1);
+    value = ((value >> 2) & 0x33333333) | ((value & 0x33333333) << 2);
+    value = ((value >> 4) & 0x0F0F0F0F) | ((value & 0x0F0F0F0F) << 4);
+    value = ((value >> 8) & 0x00FF00FF) | ((value & 0x00FF00FF) << 8);
+    return (value >> 16) | (value << 16);
+}
+
+uint32_t dma_crc32(const void *data, size_t len, uint32_t crc)
+{
+    static int dma_channel = dma_claim_unused_channel(true);
+    // The channel reads the data and drops it here
+    static uint8_t discard;
+
+    if (len == 0)
+    {
+        return crc;
+    }
+
+    auto config = dma_channel_get_default_config(dma_channel);
+    channel_config_set_transfer_data_size(&config, DMA_SIZE_8);
+    channel_config_set_read_increment(&config, true);
+    channel_config_set_write_increment(&config, false);
+    channel_config_set_sniff_enable(&config, true);
+
+    // Bit-reversed CRC-32, read out reversed and inverted, is the one zlib
+    // uses. The accumulator holds it before the final inversion and reversal.
+    dma_sniffer_enable(dma_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+    dma_sniffer_set_output_reverse_enabled(true);
+    dma_sniffer_set_output_invert_enabled(true);
+    dma_sniffer_set_data_accumulator(reverse_bits(~crc));
+
+    dma_channel_configure(dma_channel, &config, &discard, data, len, true);
+    dma_channel_wait_for_finish_blocking(dma_channel);
+
+    return dma_sniffer_get_data_accumulator();
+}
+
+void reset_pico(RebootReason reason, uint32_t detail)
+{
+    event_log.record(EventType::REBOOT, (uint8_t)reason, detail);
     printf("Rebooting in 30 seconds...\n");
 
     sleep_ms(30 * 1000);
@@ -21,13 +21,35 @@
 #include <stdio.h>
 
 #include <string>
+#include <type_traits>
 
+#include "event_log.h"
 #include "hardware/watchdog.h"
+#include "pico/flash.h"
 #include "pico/stdlib.h"
 
 inline std::string unique_board_id;
 
 std::string get_unique_board_id();
 
-void reset_pico();
+// Runs `func` with the other core and interrupts paused, so it can write to
+// flash. Takes any callable without wrapping it in a std::function, which
+// could allocate.
+template <typename Func> int flash_safe_execute(Func &&func, uint32_t enter_exit_timeout_ms)
+{
+    return flash_safe_execute([](void *arg) { (*static_cast<std::remove_reference_t<Func> *>(arg))(); }, &func,
+                              enter_exit_timeout_ms);
+}
+
+// CRC-32 as used by zlib and Ethernet. Pass the CRC of the data before to
+// continue it.
+uint32_t crc32(const void *data, size_t len, uint32_t crc = 0);
+
+// The same CRC-32, worked out by the DMA sniffer while a DMA channel reads the
+// data, so the CPU only waits for about a cycle per byte. Core 0 only, since
+// there is one sniffer.
+uint32_t dma_crc32(const void *data, size_t len, uint32_t crc = 0);
+
+// Records why in the event log, which survives the reboot
+void reset_pico(RebootReason reason, uint32_t detail = 0);
 void stall_spin();
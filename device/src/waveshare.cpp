@@ -18,6 +18,18 @@
 
 #include "waveshare.h"
 
+#include <string.h>
+
+// Partial update waveform, from the Waveshare 13.3" (K) reference driver
+static constexpr uint8_t LUT_PARTIAL[] = {
+    0x15, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x2A, 0x88, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x15, 0x44, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x01, 0x01, 0x00, 0x0A, 0x00,
+    0x05, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x01, 0x01, 0x22, 0x22, 0x22, 0x22, 0x22, 0x17, 0x41, 0xA8, 0x32, 0x18,
+};
+
 void Waveshare13K::init()
 {
     printf("[%d] -> Initializing display...\n", id);
@@ -80,32 +92,214 @@ void Waveshare13K::init()
 void Waveshare13K::shutdown()
 {
     printf("[%d] -> Shutting down display...\n", id);
+    waitForTransfer();
     reset.set(LOW);
     dc.set(LOW);
     power.set(LOW);
+    ram_valid = false;
+}
+
+void Waveshare13K::sleep()
+{
+    printf("[%d] -> Putting display to sleep...\n", id);
+    // Deep sleep mode 1, which keeps the RAM
+    sendCommand(0x10);
+    sendData(0x01);
 }
 
 void Waveshare13K::turnOnDisplay()
+{
+    startRefresh();
+    waitUntilIdle();
+    finishRefresh();
+}
+
+void Waveshare13K::startRefresh()
 {
     printf("[%d] -> Turning on display...\n", id);
     // Display Update Control
     sendCommand(0x22);
-    sendData(0xF7);
+    sendData(partial_update ? 0xCF : 0xF7);
     // Activate Display Update Sequence
     sendCommand(0x20);
-    waitUntilIdle();
 }
 
-void Waveshare13K::display(const std::array<uint8_t, 81600> &buffer)
+bool Waveshare13K::isBusy()
+{
+    return busy.isHigh();
+}
+
+uint32_t Waveshare13K::busyTimeUs(uint32_t start_us)
+{
+    auto now = time_us_32();
+    auto fall_us = busy.lastFallUs();
+
+    // An edge from before the start belongs to an earlier wait
+    if ((int32_t)(fall_us - start_us) >= 0)
+    {
+        return fall_us - start_us;
+    }
+
+    return now - start_us;
+}
+
+void Waveshare13K::finishRefresh()
+{
+    ram_valid = ram_complete;
+}
+
+void Waveshare13K::display(const std::array<uint8_t, IMAGE_SIZE> &buffer)
+{
+    startDisplay(buffer);
+    waitForTransfer();
+
+    sendCommand(0x26);
+    sendDataAsync(buffer.data(), buffer.size());
+    waitForTransfer();
+    ram_complete = true;
+
+    turnOnDisplay();
+}
+
+void Waveshare13K::startDisplay(const std::array<uint8_t, IMAGE_SIZE> &buffer)
 {
     printf("[%d] -> Displaying image...\n", id);
+    partial_update = false;
+    ram_complete = false;
+    ram_valid = false;
     sendCommand(0x24);
-    sendData(buffer.data(), buffer.size());
-    turnOnDisplay();
+    sendDataAsync(buffer.data(), buffer.size());
+}
+
+bool Waveshare13K::isTransferring() const
+{
+    return transferring;
+}
+
+void Waveshare13K::waitForTransfer()
+{
+    while (transferring)
+    {
+        tight_loop_contents();
+    }
+}
+
+void Waveshare13K::begin(const ImageRegion &region)
+{
+    partial_update = !region.is_full();
+    write_offset = 0;
+    ram_complete = true;
+    ram_valid = false;
+
+    init();
+
+    if (partial_update)
+    {
+        loadPartialWaveform();
+        setRamArea(region);
+        setRamPosition(region.x, region.y);
+    }
+
+    printf("[%d] -> Streaming image...\n", id);
+
+    if (partial_update)
+    {
+        sendCommand(0x24);
+    }
+}
+
+void Waveshare13K::write(const uint8_t *data, size_t len)
+{
+    if (partial_update)
+    {
+        sendDataAsync(data, len);
+    }
+    else
+    {
+        // Write the same data to both image RAMs, so the next update can be
+        // partial. Each RAM write restarts at the current position. The write
+        // to the previous image RAM is started from the DMA interrupt.
+        auto x = write_offset % (width / 8) * 8;
+        auto y = write_offset / (width / 8);
+
+        if (write_offset < ROW_BYTES)
+        {
+            auto count = len < ROW_BYTES - write_offset ? len : ROW_BYTES - write_offset;
+            memcpy(first_row.data() + write_offset, data, count);
+        }
+
+        setRamPosition(x, y);
+        sendCommand(NEW_RAM);
+        previous_ram_chunk = {data, len, (uint16_t)x, (uint16_t)y};
+        sendDataAsync(data, len, onNewRamWritten);
+
+        write_offset += len;
+    }
+}
+
+bool Waveshare13K::canUpdateRegion() const
+{
+    return ram_valid;
+}
+
+void Waveshare13K::writeRam(uint8_t ram, uint16_t y, const uint8_t *data, size_t len)
+{
+    setRamPosition(0, y);
+    sendCommand(ram);
+    sendData(data, len);
+}
+
+bool Waveshare13K::verifyRam(uint8_t ram, uint16_t y, const uint8_t *expected, size_t len)
+{
+    constexpr size_t CHUNK_SIZE = 64;
+    uint8_t chunk[CHUNK_SIZE];
+
+    auto baudrate = spi.getBaudrate();
+    spi.setBaudrate(SPI_READ_BAUDRATE);
+
+    // Read RAM option: which of the two RAMs the Read RAM command reads
+    sendCommand(0x41);
+    sendData(ram == PREVIOUS_RAM ? 0x01 : 0x00);
+
+    bool matches = true;
+
+    // In chunks to keep the buffer small, each read from its own position
+    for (size_t offset = 0; offset < len && matches; offset += CHUNK_SIZE)
+    {
+        auto count = len - offset < CHUNK_SIZE ? len - offset : CHUNK_SIZE;
+        auto position = y * ROW_BYTES + offset;
+
+        setRamPosition(position % ROW_BYTES * 8, position / ROW_BYTES);
+        readData(0x27, chunk, count);
+        matches = memcmp(chunk, expected + offset, count) == 0;
+    }
+
+    spi.setBaudrate(baudrate);
+    return matches;
+}
+
+bool Waveshare13K::verifyWrite()
+{
+    if (partial_update || write_offset < ROW_BYTES)
+    {
+        return true;
+    }
+
+    if (!verifyRam(NEW_RAM, 0, first_row.data(), ROW_BYTES))
+    {
+        printf("[%d] --> Image RAM doesn't hold what was written\n", id);
+        ram_complete = false;
+        return false;
+    }
+
+    return true;
 }
 
+// Each transfer first waits for the one before it, which may be to another
+// display on the same bus, to leave the bus before it touches any pins
 void Waveshare13K::sendCommand(uint8_t command)
 {
+    spi.waitForWrite();
     cs.set(LOW);
     dc.set(LOW);
     spi.write(command);
@@ -114,6 +308,7 @@ void Waveshare13K::sendCommand(uint8_t command)
 
 void Waveshare13K::sendData(uint8_t data)
 {
+    spi.waitForWrite();
     cs.set(LOW);
     dc.set(HIGH);
     spi.write(data);
@@ -122,29 +317,102 @@ void Waveshare13K::sendData(uint8_t data)
 
 void Waveshare13K::sendData(const uint8_t *data, size_t len)
 {
+    spi.waitForWrite();
     cs.set(LOW);
     dc.set(HIGH);
     spi.write(data, len);
     cs.set(HIGH);
 }
 
-void Waveshare13K::waitUntilIdle()
+void Waveshare13K::sendDataAsync(const uint8_t *data, size_t len, spi_write_done_fn callback)
+{
+    spi.waitForWrite();
+    cs.set(LOW);
+    dc.set(HIGH);
+    transferring = true;
+    spi.writeAsync(data, len, callback, this);
+}
+
+// Like sendCommand() and sendData() of each byte, from an async write's
+// callback, which holds the bus
+void Waveshare13K::sendFromCallback(uint8_t command, std::initializer_list<uint8_t> data)
+{
+    cs.set(LOW);
+    dc.set(LOW);
+    spi.writeFromCallback(&command, 1);
+    cs.set(HIGH);
+
+    for (auto byte : data)
+    {
+        cs.set(LOW);
+        dc.set(HIGH);
+        spi.writeFromCallback(&byte, 1);
+        cs.set(HIGH);
+    }
+}
+
+// Reads data after `command`. The first byte the controller sends is a dummy.
+void Waveshare13K::readData(uint8_t command, uint8_t *data, size_t len)
+{
+    uint8_t dummy;
+
+    spi.waitForWrite();
+    cs.set(LOW);
+    dc.set(LOW);
+    spi.write(command);
+    dc.set(HIGH);
+    spi.read(&dummy, 1);
+    spi.read(data, len);
+    cs.set(HIGH);
+}
+
+void Waveshare13K::onTransferDone(void *arg)
+{
+    auto screen = static_cast<Waveshare13K *>(arg);
+    screen->cs.set(HIGH);
+    screen->transferring = false;
+}
+
+// Writes a chunk of a full image to the previous image RAM once it is in the
+// new one. Only a few bytes are sent blocking, to set the RAM position.
+void Waveshare13K::onNewRamWritten(void *arg)
+{
+    auto screen = static_cast<Waveshare13K *>(arg);
+    auto &chunk = screen->previous_ram_chunk;
+    screen->cs.set(HIGH);
+
+    screen->sendFromCallback(0x4E, {(uint8_t)(chunk.x & 0xFF), (uint8_t)(chunk.x >> 8)});
+    screen->sendFromCallback(0x4F, {(uint8_t)(chunk.y & 0xFF), (uint8_t)(chunk.y >> 8)});
+    screen->sendFromCallback(PREVIOUS_RAM, {});
+
+    screen->cs.set(LOW);
+    screen->dc.set(HIGH);
+    screen->spi.continueAsync(chunk.data, chunk.len, onTransferDone, screen);
+}
+
+uint32_t Waveshare13K::waitUntilIdle()
 {
     printf("[%d] --> Waiting for display to go idle...\n", id);
-    int count = 0;
+    auto start_us = time_us_32();
+    auto timeout = make_timeout_time_ms(BUSY_TIMEOUT_MS);
 
     while (busy.isHigh())
     {
-        sleep_ms(30);
-        count++;
-
-        if (count > 1000)
+        if (time_reached(timeout))
         {
             printf("Timeout waiting for busy pin to go low\n");
             shutdown();
-            reset_pico();
+            reset_pico(RebootReason::BUSY_TIMEOUT, id);
         }
+
+        // Woken up by the busy pin's falling edge
+        best_effort_wfe_or_timeout(timeout);
     }
+
+    auto busy_us = busyTimeUs(start_us);
+    printf("[%d] --> Idle after %d us\n", id, busy_us);
+
+    return busy_us;
 }
 
 void Waveshare13K::hardwareReset()
@@ -162,3 +430,78 @@ void Waveshare13K::softwareReset()
     sendCommand(0x12);
     waitUntilIdle();
 }
+
+void Waveshare13K::loadPartialWaveform()
+{
+    // Border waveform control
+    sendCommand(0x3C);
+    sendData(0x80);
+
+    // Write LUT register
+    sendCommand(0x32);
+    sendData(LUT_PARTIAL, 105);
+
+    // Gate driving voltage
+    sendCommand(0x03);
+    sendData(LUT_PARTIAL[105]);
+
+    // Source driving voltage
+    sendCommand(0x04);
+    sendData(LUT_PARTIAL + 106, 3);
+
+    // VCOM voltage
+    sendCommand(0x2C);
+    sendData(LUT_PARTIAL[109]);
+
+    // Write register for display option, enabling display mode 2
+    sendCommand(0x37);
+    sendData(0x00);
+    sendData(0x00);
+    sendData(0x00);
+    sendData(0x00);
+    sendData(0x00);
+    sendData(0x40);
+    sendData(0x00);
+    sendData(0x00);
+    sendData(0x00);
+    sendData(0x00);
+
+    // Enable clock signal and analog, ahead of the update
+    sendCommand(0x22);
+    sendData(0xC0);
+    sendCommand(0x20);
+    waitUntilIdle();
+}
+
+void Waveshare13K::setRamArea(const ImageRegion &region)
+{
+    uint16_t x_end = region.x + region.width - 1;
+    uint16_t y_end = region.y + region.height - 1;
+
+    // Set RAM X address start/end position
+    sendCommand(0x44);
+    sendData(region.x & 0xFF);
+    sendData(region.x >> 8);
+    sendData(x_end & 0xFF);
+    sendData(x_end >> 8);
+
+    // Set RAM Y address start/end position
+    sendCommand(0x45);
+    sendData(region.y & 0xFF);
+    sendData(region.y >> 8);
+    sendData(y_end & 0xFF);
+    sendData(y_end >> 8);
+}
+
+void Waveshare13K::setRamPosition(uint16_t x, uint16_t y)
+{
+    // Set RAM X address counter
+    sendCommand(0x4E);
+    sendData(x & 0xFF);
+    sendData(x >> 8);
+
+    // Set RAM Y address counter
+    sendCommand(0x4F);
+    sendData(y & 0xFF);
+    sendData(y >> 8);
+}
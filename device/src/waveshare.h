@@ -21,16 +21,24 @@
 #include <stdio.h>
 
 #include <array>
+#include <initializer_list>
 
 #include "gpio.h"
+#include "image_sink.h"
 #include "pico/stdlib.h"
 #include "spi.h"
 #include "utils.h"
 
-class Waveshare13K
+class Waveshare13K : public ImageSink
 {
   public:
+    // Longest the display may stay busy before it is considered hung
+    static constexpr uint32_t BUSY_TIMEOUT_MS = 30 * 1000;
+
     /**
+     * Must be created on the core that drives the display, which the busy
+     * pin's interrupt wakes up.
+     *
      * @param pin_power Power pin (output). HIGH to power on.
      * @param power Power pin (output). HIGH to power on.
      * @param cs Chip Select pin (output). LOW to select the device.
@@ -42,24 +50,108 @@ class Waveshare13K
         : spi(spi), id(id), power(pin_power, LOW), cs(pin_cs, HIGH), dc(pin_dc, LOW), reset(pin_reset, HIGH),
           busy(pin_busy)
     {
+        busy.enableEdgeInterrupts();
     }
 
     void init();
     void shutdown();
     void turnOnDisplay();
 
-    void display(const std::array<uint8_t, 81600> &buffer);
+    /**
+     * Split version of `turnOnDisplay()`, so several displays can run their
+     * update waveform at the same time. Call `finishRefresh()` once
+     * `isBusy()` returns false.
+     */
+    void startRefresh();
+    bool isBusy();
+    void finishRefresh();
+
+    /**
+     * How long the display was busy after `start_us`, once it is idle again.
+     * Exact to the busy pin's falling edge, unless the interrupt for it
+     * hasn't run yet.
+     */
+    uint32_t busyTimeUs(uint32_t start_us);
+
+    int getId() const
+    {
+        return id;
+    }
+
+    /**
+     * Puts the display into deep sleep without powering it off, so the
+     * display RAM keeps the current image for later partial updates.
+     */
+    void sleep();
+
+    void display(const std::array<uint8_t, IMAGE_SIZE> &buffer);
+
+    /**
+     * Starts writing `buffer` to the display RAM in the background. The buffer
+     * must not be modified until `isTransferring()` returns false.
+     */
+    void startDisplay(const std::array<uint8_t, IMAGE_SIZE> &buffer);
+    bool isTransferring() const;
+    void waitForTransfer();
+
+    /**
+     * Streams an image into the display RAM. The display is initialized once
+     * the image starts, but nothing is shown until `turnOnDisplay()` is called,
+     * so an incomplete image can be dropped by calling `shutdown()` instead.
+     *
+     * `write()` returns while the data is still being sent, so `data` must not
+     * be modified until `isTransferring()` returns false. Anything else sent to
+     * a display waits for the transfer first.
+     *
+     * A full image is written to both the new (0x24) and previous (0x26) image
+     * RAM. A partial image is only written to the new image RAM within its
+     * region and shown with the partial update waveform, which compares it
+     * against the previous image RAM.
+     */
+    void begin(const ImageRegion &region) override;
+    void write(const uint8_t *data, size_t len) override;
+    bool canUpdateRegion() const override;
+
+    // Command of each image RAM
+    static constexpr uint8_t NEW_RAM = 0x24;
+    static constexpr uint8_t PREVIOUS_RAM = 0x26;
+    static constexpr size_t ROW_BYTES = IMAGE_WIDTH / 8;
+
+    /**
+     * Writes `len` bytes to `ram` starting at row `y`, or reads them back at
+     * SPI_READ_BAUDRATE and compares them. The display has to be initialized.
+     * Used to find out how fast the bus can be clocked.
+     */
+    void writeRam(uint8_t ram, uint16_t y, const uint8_t *data, size_t len);
+    bool verifyRam(uint8_t ram, uint16_t y, const uint8_t *expected, size_t len);
+
+    /**
+     * Checks the first row of a full image written since `begin()` against
+     * what the RAM holds. Returns false if the data got corrupted on the
+     * way, in which case the next update is a full one.
+     */
+    bool verifyWrite();
 
   private:
     void sendCommand(uint8_t command);
     void sendData(uint8_t data);
     void sendData(const uint8_t *data, size_t len);
+    void sendDataAsync(const uint8_t *data, size_t len, spi_write_done_fn callback = onTransferDone);
+    void sendFromCallback(uint8_t command, std::initializer_list<uint8_t> data);
+    void readData(uint8_t command, uint8_t *data, size_t len);
+    static void onTransferDone(void *arg);
+    static void onNewRamWritten(void *arg);
 
-    void waitUntilIdle();
+    // Sleeps until the display is idle, returning how long it was busy
+    uint32_t waitUntilIdle();
 
     void hardwareReset();
     void softwareReset();
 
+    void loadPartialWaveform();
+    void setRamArea(const ImageRegion &region);
+    void setRamPosition(uint16_t x, uint16_t y);
+
     SPI &spi;
     const int id;
     OutputPin power;
@@ -68,6 +160,29 @@ class Waveshare13K
     OutputPin reset;
     InputPin busy;
 
+    volatile bool transferring = false;
+
+    // Chunk of a full image written to the new image RAM, which goes to the
+    // previous one next
+    struct
+    {
+        const uint8_t *data;
+        size_t len;
+        uint16_t x;
+        uint16_t y;
+    } previous_ram_chunk = {};
+
+    // Whether the update being written uses the partial waveform
+    bool partial_update = false;
+    // Bytes of a full image written so far
+    size_t write_offset = 0;
+    // Whether both image RAMs will hold the image once it is turned on
+    bool ram_complete = false;
+    // Whether both image RAMs hold the image that is on screen
+    bool ram_valid = false;
+    // Start of the full image being written, for verifyWrite()
+    std::array<uint8_t, ROW_BYTES> first_row;
+
     const uint16_t width = 960;
     const uint16_t height = 680;
 };
@@ -19,25 +19,37 @@
 #include "wifi.h"
 
 #include <algorithm>
+#include <array>
 #include <map>
+#include <span>
 #include <string>
-#include <vector>
 
+#include "fixed_string.h"
 #include "pico/cyw43_arch.h"
 #include "pico/stdlib.h"
+#include "scheduler.h"
 #include "secrets.h"
+#include "state.h"
+#include "telemetry.h"
 #include "utils.h"
 
 int on_wifi_scan_complete(void *env, const cyw43_ev_scan_result_t *result);
 
+// Networks kept from a scan. Only the strongest access point of each is kept.
+constexpr size_t MAX_SCAN_RESULTS = 16;
+
 struct WiFiScanResult
 {
-    std::string ssid;
-    uint8_t bssid[6];
-    int16_t rssi;
+    FixedString<32> ssid;
+    uint8_t bssid[6] = {};
+    uint16_t channel = 0;
+    int16_t rssi = 0;
+
+    WiFiScanResult() = default;
 
-    WiFiScanResult(const cyw43_ev_scan_result_t *result) : ssid((char *)result->ssid), rssi(result->rssi)
+    WiFiScanResult(const cyw43_ev_scan_result_t *result) : channel(result->channel), rssi(result->rssi)
     {
+        ssid.assign((const char *)result->ssid, result->ssid_len);
         memcpy(bssid, result->bssid, sizeof(bssid));
     }
 };
@@ -51,25 +63,31 @@ class WiFiScan
         cyw43_wifi_scan_options_t opts = {};
 
         cyw43_wifi_scan(&cyw43_state, &opts, this, on_wifi_scan_complete);
+        printf(" -> Waiting for scan to complete...\n");
 
         while (cyw43_wifi_scan_active(&cyw43_state))
         {
-            printf(" -> Waiting for scan to complete...\n");
-            sleep_ms(1000);
+            sleep_ms(50);
         }
 
-        std::sort(results.begin(), results.end(), [](const WiFiScanResult &a, const WiFiScanResult &b) {
+        std::sort(found().begin(), found().end(), [](const WiFiScanResult &a, const WiFiScanResult &b) {
             return a.rssi > b.rssi; // stronger signal first
         });
         printf("WiFi scan complete. Results:\n");
 
-        for (const auto &result : results)
+        for (const auto &result : found())
         {
             printf("- %-32s   rssi: %d\n", result.ssid.c_str(), result.rssi);
         }
     }
 
-    std::vector<WiFiScanResult> results;
+    std::span<WiFiScanResult> found()
+    {
+        return {results.data(), result_count};
+    }
+
+    std::array<WiFiScanResult, MAX_SCAN_RESULTS> results;
+    size_t result_count = 0;
 };
 
 int on_wifi_scan_complete(void *env, const cyw43_ev_scan_result_t *result)
@@ -95,28 +113,127 @@ int on_wifi_scan_complete(void *env, const cyw43_ev_scan_result_t *result)
            scan_result.bssid[0], scan_result.bssid[1], scan_result.bssid[2], scan_result.bssid[3], scan_result.bssid[4],
            scan_result.bssid[5], scan_result.rssi);
 
-    auto existingResult = std::find_if(scan->results.begin(), scan->results.end(),
+    auto found = scan->found();
+    auto existingResult = std::find_if(found.begin(), found.end(),
                                        [&scan_result](const WiFiScanResult &r) { return r.ssid == scan_result.ssid; });
 
-    if (existingResult != scan->results.end())
+    if (existingResult != found.end())
     {
         // Update the existing result if the new one has a stronger signal
         if (scan_result.rssi > existingResult->rssi)
         {
             memcpy(existingResult->bssid, scan_result.bssid, sizeof(scan_result.bssid));
+            existingResult->channel = scan_result.channel;
             existingResult->rssi = scan_result.rssi;
         }
     }
+    else if (scan->result_count < scan->results.size())
+    {
+        scan->results[scan->result_count++] = scan_result;
+    }
     else
     {
-        scan->results.push_back(scan_result);
+        printf(" -> Too many networks, skipping %s\n", scan_result.ssid.c_str());
     }
 
     return 0;
 }
 
+// Network joined by setup_wifi(), rejoined by monitor_wifi() with the same
+// auth mode. The SSID and password point into WIFI_SSIDS.
+const char *joined_ssid = nullptr;
+const char *joined_password = nullptr;
+uint32_t joined_auth = CYW43_AUTH_WPA2_AES_PSK;
+
+// Used to join networks found by scanning
+constexpr uint32_t SCAN_AUTH = CYW43_AUTH_WPA2_AES_PSK;
+
+constexpr uint32_t LINK_CHECK_INTERVAL_MS = 10 * 1000;
+constexpr uint32_t REJOIN_TIMEOUT_MS = 30 * 1000;
+// Joining a known access point on a known channel takes a few seconds at most,
+// including DHCP. After that the scan is likely to be quicker.
+constexpr uint32_t SAVED_NETWORK_TIMEOUT_MS = 8 * 1000;
+
+// Joins the network saved in the state without scanning for it first.
+// Returns false if that fails, e.g. because the access point was replaced.
+bool join_saved_network()
+{
+    if (!flash_saved_state->has_wifi_network())
+    {
+        return false;
+    }
+
+    auto &network = flash_saved_state->wifi_network;
+    auto entry = WIFI_SSIDS.find(network.ssid);
+
+    if (entry == WIFI_SSIDS.end())
+    {
+        printf("Saved network %s is no longer known\n", network.ssid);
+        return false;
+    }
+
+    auto ssid = entry->first.c_str();
+    auto password = entry->second.c_str();
+
+    printf("Joining saved network %s (MAC %02x:%02x:%02x:%02x:%02x:%02x, channel %d)\n", ssid, network.bssid[0],
+           network.bssid[1], network.bssid[2], network.bssid[3], network.bssid[4], network.bssid[5], network.channel);
+
+    // Like cyw43_arch_wifi_connect_bssid_timeout_ms(), which can't be given
+    // the channel
+    int res = cyw43_wifi_join(&cyw43_state, strlen(ssid), (const uint8_t *)ssid, strlen(password),
+                              (const uint8_t *)password, network.auth, network.bssid, network.channel);
+
+    if (res != 0)
+    {
+        printf("- Failed to join saved network: %d\n", res);
+        return false;
+    }
+
+    auto deadline = make_timeout_time_ms(SAVED_NETWORK_TIMEOUT_MS);
+    int status;
+
+    while ((status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA)) != CYW43_LINK_UP)
+    {
+        if (status < 0 || time_reached(deadline))
+        {
+            printf("- Failed to join saved network, link status %d\n", status);
+            cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+            return false;
+        }
+
+        cyw43_arch_poll();
+        cyw43_arch_wait_for_work_until(deadline);
+    }
+
+    joined_ssid = ssid;
+    joined_password = password;
+    joined_auth = network.auth;
+    return true;
+}
+
+// Saves the network so the next boot can join it right away
+void save_network(const char *ssid, const WiFiScanResult &result, uint32_t auth)
+{
+    WiFiNetwork network = {};
+    strncpy(network.ssid, ssid, sizeof(network.ssid) - 1);
+    memcpy(network.bssid, result.bssid, sizeof(network.bssid));
+    network.channel = result.channel;
+    network.auth = auth;
+
+    if (flash_saved_state->has_wifi_network() && flash_saved_state->wifi_network == network)
+    {
+        return;
+    }
+
+    SavedState new_state(flash_saved_state);
+    new_state.wifi_network = network;
+    new_state.save();
+}
+
 void setup_wifi()
 {
+    auto start = time_us_32();
+
     // Initialise the Wi-Fi chip
     if (cyw43_arch_init())
     {
@@ -127,7 +244,13 @@ void setup_wifi()
     // Enable wifi station
     cyw43_arch_enable_sta_mode();
 
-    bool scan_in_progress = false;
+    if (join_saved_network())
+    {
+        auto elapsed_us = time_us_32() - start;
+        printf("- Connected to %s in %d ms without scanning\n", joined_ssid, elapsed_us / 1000);
+        telemetry.record(Phase::WIFI_CONNECT, elapsed_us);
+        return;
+    }
 
     while (true)
     {
@@ -136,9 +259,9 @@ void setup_wifi()
 
         bool found_ssid = false;
 
-        for (const auto &result : wifi_scan.results)
+        for (const auto &result : wifi_scan.found())
         {
-            auto entry = WIFI_SSIDS.find(result.ssid);
+            auto entry = WIFI_SSIDS.find(result.ssid.c_str());
 
             if (entry != WIFI_SSIDS.end())
             {
@@ -153,12 +276,17 @@ void setup_wifi()
 
                 for (int i = 0; i < 5; i++)
                 {
-                    int res = cyw43_arch_wifi_connect_bssid_timeout_ms(ssid, result.bssid, password,
-                                                                       CYW43_AUTH_WPA2_AES_PSK, 30000);
+                    int res = cyw43_arch_wifi_connect_bssid_timeout_ms(ssid, result.bssid, password, SCAN_AUTH, 30000);
 
                     if (res == PICO_OK)
                     {
-                        printf("- Connected to %s\n", ssid);
+                        auto elapsed_us = time_us_32() - start;
+                        printf("- Connected to %s in %d ms\n", ssid, elapsed_us / 1000);
+                        telemetry.record(Phase::WIFI_CONNECT, elapsed_us);
+                        joined_ssid = ssid;
+                        joined_password = password;
+                        joined_auth = SCAN_AUTH;
+                        save_network(ssid, result, SCAN_AUTH);
                         return;
                     }
                     else if (res == PICO_ERROR_BADAUTH)
@@ -179,7 +307,7 @@ void setup_wifi()
                     }
 
                     sleep_ms(1000);
-                    printf("- Retrying connection...\n", ssid);
+                    printf("- Retrying connection...\n");
                 }
             }
         }
@@ -198,3 +326,43 @@ void setup_wifi()
         }
     }
 }
+
+Task<void> monitor_wifi()
+{
+    while (true)
+    {
+        co_await scheduler.sleep(LINK_CHECK_INTERVAL_MS);
+
+        if (cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_UP)
+        {
+            continue;
+        }
+
+        printf("Lost the connection to %s, rejoining...\n", joined_ssid);
+        auto start = time_us_32();
+
+        if (cyw43_arch_wifi_connect_async(joined_ssid, joined_password, joined_auth) != 0)
+        {
+            printf("Failed to start rejoining %s\n", joined_ssid);
+            reset_pico(RebootReason::WIFI_LOST);
+        }
+
+        int status;
+
+        // Other tasks keep running meanwhile, and their requests fail or time
+        // out until the link is back
+        while ((status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA)) != CYW43_LINK_UP)
+        {
+            if (status < 0 || time_us_32() - start > REJOIN_TIMEOUT_MS * 1000)
+            {
+                printf("Rejoining %s failed: %d\n", joined_ssid, status);
+                reset_pico(RebootReason::WIFI_LOST, status < 0 ? -status : 0);
+            }
+
+            co_await scheduler.sleep(100);
+        }
+
+        printf("Rejoined %s\n", joined_ssid);
+        telemetry.record(Phase::WIFI_CONNECT, time_us_32() - start);
+    }
+}
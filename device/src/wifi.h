@@ -20,4 +20,11 @@
 
 #include <map>
 
+#include "task.h"
+
+// Joins the strongest known network, blocking until it has.
 void setup_wifi();
+
+// Rejoins the network whenever the connection drops, resetting the device if
+// that fails.
+Task<void> monitor_wifi();
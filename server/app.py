@@ -24,11 +24,26 @@ from flask import (
     send_from_directory,
     redirect,
 )
-from PIL import Image, ImageDraw, ImageFont
+from PIL import Image, ImageChops, ImageDraw, ImageFont
 from http import HTTPStatus
+import contextlib
+import fcntl
+import functools
 import os
 import hashlib
+import io
 import json
+import re
+import struct
+import tempfile
+import time
+import zlib
+
+# Native renderer from native/, when it has been built
+try:
+    import ehymnboard_render
+except ImportError:
+    ehymnboard_render = None
 
 app = Flask(__name__)
 
@@ -53,6 +68,53 @@ LINE2_BOTTOM = SCREEN_HEIGHT
 LINE1_CENTER_Y = LINE1_TOP + LINE_HEIGHT / 2
 LINE2_CENTER_Y = LINE2_TOP + LINE_HEIGHT / 2
 
+# The screens of the board, which devices fetch as images 1 to SCREEN_COUNT,
+# see device/src/screens.h. Each shows two of the lines entered on the index
+# page, in order.
+MAX_SCREENS = 4
+SCREEN_COUNT = int(os.getenv("SCREEN_COUNT", "3"))
+SCREEN_IDS = list(range(1, SCREEN_COUNT + 1))
+LINES_PER_SCREEN = 2
+LINE_COUNT = SCREEN_COUNT * LINES_PER_SCREEN
+
+if not 1 <= SCREEN_COUNT <= MAX_SCREENS:
+    raise ValueError(f"SCREEN_COUNT has to be from 1 to {MAX_SCREENS}")
+
+# Number of previous images kept per screen, so devices still showing one of
+# them can be sent just the part of the screen that changed
+IMAGE_HISTORY_SIZE = 10
+# Above this fraction of the screen, a full refresh is sent instead
+MAX_PARTIAL_UPDATE_AREA = 0.5
+
+# Longest a manifest request is held waiting for a change, kept below the read
+# timeout of the proxy in front of the app and of gunicorn
+MAX_MANIFEST_WAIT = 55
+MANIFEST_POLL_INTERVAL = 0.2
+
+# Devices report how long each phase of a refresh took, see
+# device/src/telemetry.h. Their totals are kept in one file per device.
+DEVICES_DIR = "images/devices"
+DEVICE_ID_PATTERN = re.compile(r"[0-9A-Za-z]{1,32}")
+TELEMETRY_PHASE_PATTERN = re.compile(r"[a-z]+[0-9]*")
+# Upper bounds of the histogram buckets in ms, the last bucket has no bound
+TELEMETRY_BUCKET_BOUNDS_MS = [1, 4, 16, 64, 256, 1024, 4096]
+
+# After a reboot, devices upload the events that led up to it, see
+# device/src/event_log.h. Each is the time in ms since that boot, the type, an
+# argument and a value, little-endian.
+EVENT_FORMAT = struct.Struct("<IBBH")
+EVENT_TYPES = ["boot", "phase", "http", "retry", "reboot"]
+REBOOT_REASONS = ["fetch_failed", "busy_timeout", "state_save_failed", "wifi_lost"]
+# In the order of Phase in device/src/telemetry.h. The display phases are
+# numbered by screen, like in the telemetry summary.
+EVENT_PHASES = ["wifi", "dns", "tcp", "ttfb", "body", "flash", "spi", "busy"]
+FIRST_DISPLAY_PHASE = EVENT_PHASES.index("spi")
+# Events kept per device, older ones are dropped
+MAX_DEVICE_EVENTS = 1000
+
+# Devices resume a download that broke off with "Range: bytes=<start>-"
+RANGE_PATTERN = re.compile(r"bytes=([0-9]+)-")
+
 
 def require_basic_auth(f):
     @wraps(f)
@@ -93,7 +155,7 @@ def index():
     except OSError:
         lines = []
 
-    return render_template("index.html", lines=lines)
+    return render_template("index.html", lines=lines, line_count=LINE_COUNT)
 
 
 @app.post("/images")
@@ -102,48 +164,99 @@ def create_image():
     action = request.form["action"]
 
     if action == "apply":
-        line1 = request.form["line1"]
-        line2 = request.form["line2"]
-        line3 = request.form["line3"]
-        line4 = request.form["line4"]
-        line5 = request.form["line5"]
-        line6 = request.form["line6"]
+        lines = [request.form[f"line{i + 1}"] for i in range(LINE_COUNT)]
     elif action == "clear":
-        line1 = ""
-        line2 = ""
-        line3 = ""
-        line4 = ""
-        line5 = ""
-        line6 = ""
+        lines = [""] * LINE_COUNT
     else:
         raise ValueError("Invalid action")
 
-    generate_image("1", line1, line2)
-    generate_image("2", line3, line4)
-    generate_image("3", line5, line6)
+    for image_id in SCREEN_IDS:
+        first = (image_id - 1) * LINES_PER_SCREEN
+        generate_image(str(image_id), *lines[first : first + LINES_PER_SCREEN])
 
     with open("images/lines.json", "w") as f:
-        json.dump([line1, line2, line3, line4, line5, line6], f)
+        json.dump(lines, f)
 
     return redirect("/", code=HTTPStatus.FOUND)
 
 
 @app.get("/images/<int:image_id>.png")
 def get_image_png(image_id):
+    if image_id not in SCREEN_IDS:
+        return "", HTTPStatus.NOT_FOUND
+
     if not os.path.exists(f"images/{image_id}.png"):
         generate_image(image_id, "", "")
 
     return send_from_directory("images", f"{image_id}.png")
 
 
+@app.get("/images/manifest")
+def get_manifest():
+    """
+    List the current ETag of every screen, one "<image id> <etag>" per line,
+    so devices can check all screens with a single request.
+
+    Devices can pass the ETags they show as a comma separated "etags" list,
+    along with "wait" seconds to hold the request until one of them changes.
+    """
+    record_device_report()
+
+    etags = {image_id: image_etag(image_id) for image_id in SCREEN_IDS}
+
+    wait = min(request.args.get("wait", 0, type=float), MAX_MANIFEST_WAIT)
+    known_etags = dict(zip(SCREEN_IDS, request.args.get("etags", "").split(",")))
+
+    if wait > 0 and known_etags == etags:
+        etags = wait_for_change(known_etags, time.monotonic() + wait)
+
+    lines = [f"{image_id} {etag}\n" for image_id, etag in etags.items()]
+
+    response = make_response("".join(lines))
+    response.content_type = "text/plain"
+    response.headers["Cache-Control"] = "no-cache"
+
+    return response
+
+
+@app.get("/telemetry")
+@require_basic_auth
+def get_telemetry():
+    """
+    Where the devices spend their time: the totals of every device and of the
+    whole fleet, per phase, with times in ms.
+    """
+    devices = {}
+    fleet = {}
+
+    if os.path.isdir(DEVICES_DIR):
+        for entry in os.scandir(DEVICES_DIR):
+            if not entry.name.endswith(".json"):
+                continue
+
+            with open(entry.path, "r") as f:
+                device = json.load(f)
+
+            merge_telemetry(fleet, device["phases"])
+            device["phases"] = summarize_telemetry(device["phases"])
+            devices[entry.name.removesuffix(".json")] = device
+
+    return {
+        "bucket_bounds_ms": TELEMETRY_BUCKET_BOUNDS_MS,
+        "fleet": summarize_telemetry(fleet),
+        "devices": devices,
+    }
+
+
 @app.get("/images/<int:image_id>")
 def get_image(image_id):
-    if not os.path.exists(f"images/{image_id}.png"):
-        generate_image(image_id, "", "")
+    if image_id not in SCREEN_IDS:
+        return "", HTTPStatus.NOT_FOUND
 
-    with open(f"images/{image_id}.png", "rb") as file:
-        image_data = file.read()
-        image_hash = hashlib.sha1(image_data).hexdigest()
+    # Hashed and decoded from one read, so the ETag names the image sent even
+    # if the file is replaced meanwhile
+    data = read_image(image_id)
+    image_hash = hashlib.sha1(data).hexdigest()
 
     if_none_match = request.headers.get("If-None-Match") or request.args.get("etag")
 
@@ -151,33 +264,424 @@ def get_image(image_id):
     if if_none_match == image_hash:
         response = make_response("", 304)
     else:
-        image = Image.open(f"images/{image_id}.png")
-        buffer = image_to_buffer(image)
+        image = Image.open(io.BytesIO(data))
+        region = None
+
+        if request.args.get("partial") == "1" and if_none_match:
+            region = changed_region(image_id, if_none_match, image)
+
+        if region:
+            x, y, width, height = region
+            buffer = image_to_buffer(image.crop((x, y, x + width, y + height)))
+        else:
+            buffer = image_to_buffer(image)
 
-        response = make_response(buffer)
+        packbits = request.args.get("encoding") == "packbits"
+        body = packbits_encode(buffer) if packbits else buffer
+        is_delta = False
+
+        # Devices that still have the frame they show can take the new image
+        # XORed with it instead. What didn't change is zero, which compresses
+        # well, but a busy region can end up larger, so the smaller one is sent.
+        if packbits and request.args.get("delta") == "1" and if_none_match:
+            base = history_frame(image_id, if_none_match)
+
+            if base:
+                delta = packbits_encode(xor_bytes(buffer, crop_frame(base, region)))
+
+                if len(delta) < len(body):
+                    body = delta
+                    is_delta = True
+
+        response = make_response_range(body, image_hash)
         response.content_type = "application/octet-stream"
 
+        if packbits:
+            response.headers["Content-Encoding"] = "packbits"
+
+        if region:
+            response.headers["X-Update-Region"] = ",".join(str(v) for v in region)
+
+        if is_delta:
+            response.headers["X-Delta"] = "xor"
+
+        # The device can't check the ETag, so it checks what it decoded against
+        # this before showing it, and asks again if it doesn't match
+        response.headers["X-Frame-CRC"] = f"{zlib.crc32(buffer):08x}"
+
     response.headers["ETag"] = image_hash
 
     return response
 
 
-def image_to_buffer(image: Image.Image) -> bytes:
-    buffer = bytearray(int(image.width / 8) * image.height)
-    image = image.convert("1")
-    pixels = image.load()
+def make_response_range(body: bytes, etag: str) -> Response:
+    """
+    Respond with the part of the body asked for with Range, as long as
+    If-Range names the current image, and with all of it otherwise. Only
+    ranges from a byte to the end are supported, which is what devices use.
+    """
+    range_match = RANGE_PATTERN.fullmatch(request.headers.get("Range", ""))
+
+    if not range_match or request.headers.get("If-Range") != etag:
+        response = make_response(body)
+    elif int(range_match[1]) < len(body):
+        start = int(range_match[1])
+        response = make_response(body[start:], HTTPStatus.PARTIAL_CONTENT)
+        response.headers["Content-Range"] = f"bytes {start}-{len(body) - 1}/{len(body)}"
+    else:
+        response = make_response("", HTTPStatus.REQUESTED_RANGE_NOT_SATISFIABLE)
+        response.headers["Content-Range"] = f"bytes */{len(body)}"
+
+    response.headers["Accept-Ranges"] = "bytes"
+
+    return response
+
+
+def record_device_report():
+    """
+    Add the telemetry summary a device sent along with its request to the
+    totals kept for that device.
+    """
+    device_id = request.headers.get("X-Device-Id", "")
+    summary = request.headers.get("X-Telemetry")
+
+    if not summary or not DEVICE_ID_PATTERN.fullmatch(device_id):
+        return
+
+    with lock_device(device_id):
+        device = load_device(device_id)
+        merge_telemetry(device["phases"], parse_telemetry(summary))
+        device["last_report"] = time.time()
+        device["saved_state_writes"] = request.headers.get("X-Saved-State-Writes", type=int)
+        save_device(device_id, device)
+
+
+@contextlib.contextmanager
+def lock_device(device_id: str):
+    """
+    Hold a lock on a device's file while updating it, which requests from the
+    same device on several connections would otherwise do at the same time.
+    A file lock, as they may be handled by different worker processes.
+    """
+    os.makedirs(DEVICES_DIR, exist_ok=True)
+
+    with open(f"{DEVICES_DIR}/{device_id}.lock", "w") as lock_file:
+        fcntl.flock(lock_file, fcntl.LOCK_EX)
+        yield
+
+
+def load_device(device_id: str) -> dict:
+    try:
+        with open(f"{DEVICES_DIR}/{device_id}.json", "r") as f:
+            return json.load(f)
+    except (OSError, ValueError):
+        return {"phases": {}}
+
+
+def save_device(device_id: str, device: dict):
+    # Replace the file in one go, so readers never see half of it
+    replace_file(f"{DEVICES_DIR}/{device_id}.json", json.dumps(device).encode())
+
+
+@app.post("/events")
+def post_events():
+    """
+    Keep the events a device recorded before it rebooted, which tell what led
+    up to it, along with a count of the reasons it rebooted for.
+    """
+    device_id = request.headers.get("X-Device-Id", "")
+    body = request.get_data()
+
+    if not DEVICE_ID_PATTERN.fullmatch(device_id) or len(body) % EVENT_FORMAT.size != 0:
+        return "", HTTPStatus.BAD_REQUEST
+
+    events = [decode_event(*fields) for fields in EVENT_FORMAT.iter_unpack(body)]
+
+    with lock_device(device_id):
+        device = load_device(device_id)
+        device["events"] = (device.get("events", []) + events)[-MAX_DEVICE_EVENTS:]
+        reboots = device.setdefault("reboots", {})
+
+        for event in events:
+            if event["event"] == "reboot":
+                reboots[event["reason"]] = reboots.get(event["reason"], 0) + 1
+
+        save_device(device_id, device)
+
+    return "", HTTPStatus.NO_CONTENT
+
+
+def decode_event(time_ms: int, event_type: int, arg: int, value: int) -> dict:
+    """Spell out what a packed event means, see EventType on the device."""
+    name = EVENT_TYPES[event_type] if event_type < len(EVENT_TYPES) else str(event_type)
+    event = {"time_ms": time_ms, "event": name}
+
+    if name == "boot":
+        event["watchdog"] = bool(arg)
+    elif name == "phase":
+        phase, screen = arg % 16, arg // 16
+        phase_name = EVENT_PHASES[phase] if phase < len(EVENT_PHASES) else str(phase)
+        event["phase"] = f"{phase_name}{screen + 1}" if phase >= FIRST_DISPLAY_PHASE else phase_name
+        event["ms"] = value
+    elif name == "http":
+        event["image"] = arg
+        event["status"] = value
+    elif name == "retry":
+        event["image"] = arg
+        event["attempt"] = value
+    elif name == "reboot":
+        event["reason"] = REBOOT_REASONS[arg] if arg < len(REBOOT_REASONS) else str(arg)
+        event["detail"] = value
+    else:
+        event["arg"] = arg
+        event["value"] = value
+
+    return event
+
+
+def parse_telemetry(summary: str) -> dict:
+    """
+    Parse "<phase>=<count>,<min>,<avg>,<max>,<histogram>;..." with times in ms
+    and the histogram bucket counts separated by dots. Malformed phases are
+    skipped.
+    """
+    phases = {}
+
+    for entry in summary.split(";"):
+        name, _, values = entry.strip().partition("=")
+        values = values.split(",")
+
+        if not TELEMETRY_PHASE_PATTERN.fullmatch(name) or len(values) != 5:
+            continue
+
+        try:
+            count, min_ms, avg_ms, max_ms = (int(value) for value in values[:4])
+            histogram = [int(value) for value in values[4].split(".")]
+        except ValueError:
+            continue
+
+        buckets = len(TELEMETRY_BUCKET_BOUNDS_MS) + 1
+
+        if count <= 0 or len(histogram) > buckets:
+            continue
+
+        phases[name] = {
+            "count": count,
+            "min_ms": min_ms,
+            "max_ms": max_ms,
+            "total_ms": avg_ms * count,
+            "histogram": histogram + [0] * (buckets - len(histogram)),
+        }
+
+    return phases
+
+
+def merge_telemetry(totals: dict, phases: dict):
+    """Add the phases of one report to the totals, in place."""
+    for name, phase in phases.items():
+        total = totals.get(name)
+
+        if total is None:
+            totals[name] = dict(phase, histogram=list(phase["histogram"]))
+            continue
+
+        total["count"] += phase["count"]
+        total["min_ms"] = min(total["min_ms"], phase["min_ms"])
+        total["max_ms"] = max(total["max_ms"], phase["max_ms"])
+        total["total_ms"] += phase["total_ms"]
+        total["histogram"] = [a + b for a, b in zip(total["histogram"], phase["histogram"])]
+
 
-    for y in range(image.height):
-        for x in range(image.width):
-            if pixels[x, y]:
-                buffer[int((x + y * image.width) / 8)] |= 0b1000_0000 >> (x % 8)
+def summarize_telemetry(totals: dict) -> dict:
+    return {
+        name: {
+            "count": total["count"],
+            "min_ms": total["min_ms"],
+            "avg_ms": round(total["total_ms"] / total["count"]),
+            "max_ms": total["max_ms"],
+            "histogram": total["histogram"],
+        }
+        for name, total in sorted(totals.items())
+    }
 
-    return bytes(buffer)
+
+def read_image(image_id: int) -> bytes:
+    if not os.path.exists(f"images/{image_id}.png"):
+        generate_image(image_id, "", "")
+
+    with open(f"images/{image_id}.png", "rb") as file:
+        return file.read()
+
+
+def image_etag(image_id: int) -> str:
+    return hashlib.sha1(read_image(image_id)).hexdigest()
+
+
+def wait_for_change(known_etags: dict, deadline: float) -> dict:
+    """
+    Wait until the ETag of a screen differs from known_etags, or until the
+    deadline. Only rehashes the images when one of the files was replaced.
+    """
+    etags = known_etags
+    mtimes = image_mtimes()
+
+    while etags == known_etags and time.monotonic() < deadline:
+        time.sleep(MANIFEST_POLL_INTERVAL)
+
+        if image_mtimes() != mtimes:
+            mtimes = image_mtimes()
+            etags = {image_id: image_etag(image_id) for image_id in SCREEN_IDS}
+
+    return etags
+
+
+def image_mtimes() -> list:
+    return [os.stat(f"images/{image_id}.png").st_mtime_ns for image_id in SCREEN_IDS]
+
+
+def changed_region(image_id: int, etag: str, image: Image.Image):
+    """
+    Find the part of the screen that changed since the image with the given
+    ETag, as (x, y, width, height) with x and width aligned to whole bytes.
+    Returns None if the old image is unknown or most of the screen changed.
+    """
+    old_path = f"images/history/{image_id}/{os.path.basename(etag)}.png"
+
+    # The copy may have been pruned since the device got it
+    try:
+        old_image = Image.open(old_path).convert("L")
+    except OSError:
+        return None
+
+    bbox = ImageChops.difference(old_image, image.convert("L")).getbbox()
+
+    if not bbox:
+        return None
+
+    left, top, right, bottom = bbox
+    left = left // 8 * 8
+    right = (right + 7) // 8 * 8
+    width = right - left
+    height = bottom - top
+
+    if width * height > SCREEN_WIDTH * SCREEN_HEIGHT * MAX_PARTIAL_UPDATE_AREA:
+        return None
+
+    return (left, top, width, height)
+
+
+@functools.lru_cache(maxsize=len(SCREEN_IDS) * IMAGE_HISTORY_SIZE)
+def load_history_frame(image_id: int, etag: str) -> bytes:
+    """
+    The packed frame of an image in the history. Kept in memory, since an
+    ETag always names the same image.
+    """
+    with Image.open(f"images/history/{image_id}/{os.path.basename(etag)}.png") as image:
+        return image_to_buffer(image)
+
+
+def history_frame(image_id: int, etag: str) -> bytes | None:
+    """The packed frame of an image in the history, or None if it is unknown."""
+    try:
+        return load_history_frame(image_id, etag)
+    except OSError:
+        return None
+
+
+def crop_frame(frame: bytes, region) -> bytes:
+    """Cut (x, y, width, height) out of a packed frame, or keep all of it."""
+    if not region:
+        return frame
+
+    x, y, width, height = region
+    row_bytes = SCREEN_WIDTH // 8
+    start = x // 8
+
+    return b"".join(
+        frame[row * row_bytes + start : row * row_bytes + start + width // 8]
+        for row in range(y, y + height)
+    )
+
+
+def xor_bytes(a: bytes, b: bytes) -> bytes:
+    return (int.from_bytes(a, "big") ^ int.from_bytes(b, "big")).to_bytes(len(a), "big")
+
+
+def image_to_buffer(image: Image.Image) -> bytes:
+    """
+    Pack the image 1 bit per pixel, the leftmost pixel in the most significant
+    bit, which is how PIL stores 1 bit images already.
+    """
+    return image.convert("1").tobytes()
+
+
+def packbits_encode(data: bytes) -> bytes:
+    """Compress data using PackBits, which the device can decode as it streams in."""
+    output = bytearray()
+    i = 0
+
+    while i < len(data):
+        run_length = 1
+        while (
+            i + run_length < len(data)
+            and run_length < 128
+            and data[i + run_length] == data[i]
+        ):
+            run_length += 1
+
+        if run_length >= 3:
+            output.append(257 - run_length)
+            output.append(data[i])
+            i += run_length
+            continue
+
+        # Copy bytes literally until the next run of at least 3 bytes
+        start = i
+        i += 1
+        while (
+            i < len(data)
+            and i - start < 128
+            and not (i + 2 < len(data) and data[i] == data[i + 1] == data[i + 2])
+        ):
+            i += 1
+
+        output.append(i - start - 1)
+        output += data[start:i]
+
+    return bytes(output)
 
 
 def generate_image(name: int | str, line1: str, line2: str):
     os.makedirs("images", exist_ok=True)
 
+    if ehymnboard_render:
+        image = render_lines_native(line1, line2)
+    else:
+        image = render_lines(line1, line2)
+
+    png = io.BytesIO()
+    image.save(png, format="PNG")
+
+    # Replaced in one step, as devices may be downloading the old one
+    replace_file(f"images/{name}.png", png.getvalue())
+    save_image_history(name, png.getvalue())
+
+
+def replace_file(path: str, data: bytes):
+    """
+    Write the file under a temporary name of its own and rename it over the
+    old one. Readers see either file whole, and the other worker processes
+    writing it at the same time don't get in the way.
+    """
+    with tempfile.NamedTemporaryFile(
+        dir=os.path.dirname(path), prefix=os.path.basename(path), suffix=".tmp", delete=False
+    ) as file:
+        file.write(data)
+
+    os.replace(file.name, path)
+
+
+def render_lines(line1: str, line2: str) -> Image.Image:
     image = Image.new("1", (960, 680), 0)
     draw = ImageDraw.Draw(image)
 
@@ -187,7 +691,55 @@ def generate_image(name: int | str, line1: str, line2: str):
     draw_centered_text(draw, line1, line1_font, LINE1_CENTER_Y)
     draw_centered_text(draw, line2, line2_font, LINE2_CENTER_Y)
 
-    image.save(f"images/{name}.png")
+    return image
+
+
+def render_lines_native(line1: str, line2: str) -> Image.Image:
+    """
+    Same as render_lines(), but with the native renderer, which caches glyphs
+    and draws straight into the packed layout the device expects. Glyphs can
+    end up a pixel off from where PIL draws them.
+    """
+    lines = []
+
+    for text, center_y in ((line1, LINE1_CENTER_Y), (line2, LINE2_CENTER_Y)):
+        if not text:
+            continue
+
+        size = ehymnboard_render.fit_font_size(FONT_NAME, text, MAX_LINE_WIDTH, MAX_FONT_SIZE)
+
+        if size > 0:
+            text_width = ehymnboard_render.text_length(FONT_NAME, text, size)
+            lines.append((text, size, (SCREEN_WIDTH - text_width) / 2, center_y - size / 2))
+
+    buffer = ehymnboard_render.render(FONT_NAME, SCREEN_WIDTH, SCREEN_HEIGHT, lines)
+
+    return Image.frombytes("1", (SCREEN_WIDTH, SCREEN_HEIGHT), buffer)
+
+
+def save_image_history(name: int | str, png: bytes):
+    """Keep a copy of the image under its ETag, pruning the oldest copies."""
+    history_dir = f"images/history/{name}"
+    os.makedirs(history_dir, exist_ok=True)
+
+    image_hash = hashlib.sha1(png).hexdigest()
+    replace_file(f"{history_dir}/{image_hash}.png", png)
+
+    # Other workers may be pruning at the same time, or writing copies
+    history = []
+
+    for entry in os.scandir(history_dir):
+        try:
+            if entry.name.endswith(".png"):
+                history.append((entry.stat().st_mtime, entry.path))
+        except FileNotFoundError:
+            pass
+
+    for _, path in sorted(history, reverse=True)[IMAGE_HISTORY_SIZE:]:
+        try:
+            os.remove(path)
+        except FileNotFoundError:
+            pass
 
 
 def calculate_font_size(draw: ImageDraw.ImageDraw, text: str, font_name: str):
@@ -8,7 +8,9 @@ accesslog = "-"
 access_log_format = "%(h)s %(l)s %(u)s %(t)s '%(r)s' %(s)s %(b)s '%(f)s' '%(a)s' in %(D)sµs"  # noqa: E501
 
 workers = int(os.getenv("WEB_CONCURRENCY", multiprocessing.cpu_count() * 2))
-threads = int(os.getenv("PYTHON_MAX_THREADS", 1))
+# Devices hold a manifest request open while waiting for changes, so each
+# worker needs threads to spare for them
+threads = int(os.getenv("PYTHON_MAX_THREADS", 8))
 
 reload = bool(str2bool(os.getenv("WEB_RELOAD", "false")))
 
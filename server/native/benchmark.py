@@ -0,0 +1,129 @@
+# eHymnBoard web app and backend server
+# Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# Compares rendering a screen with PIL, the way the server did before the
+# native renderer, against the native renderer. Times are the best of a few
+# rounds, so the native glyph cache is warm, as it is in a running server. Run
+# from the server directory once the extension is installed:
+#
+#    python native/benchmark.py
+
+import os
+import sys
+import time
+
+from PIL import Image, ImageDraw
+
+# The app, which loads its fonts relative to the server directory
+sys.path.insert(0, os.getcwd())
+import app  # noqa: E402
+import ehymnboard_render
+
+SCREENS = [
+    ("123", "456"),
+    ("LSB 457", "vv. 1-4"),
+    ("Psalm 23", ""),
+    ("Hymn 801 vv. 1-4", "Offertory"),
+]
+ROUNDS = 5
+
+
+def pack_pixels(image: Image.Image) -> bytes:
+    """How image_to_buffer() used to pack the pixels."""
+    buffer = bytearray(int(image.width / 8) * image.height)
+    pixels = image.load()
+
+    for y in range(image.height):
+        for x in range(image.width):
+            if pixels[x, y]:
+                buffer[int((x + y * image.width) / 8)] |= 0b1000_0000 >> (x % 8)
+
+    return bytes(buffer)
+
+
+def render_pil(line1: str, line2: str) -> bytes:
+    return pack_pixels(app.render_lines(line1, line2))
+
+
+def render_native(line1: str, line2: str) -> bytes:
+    return app.render_lines_native(line1, line2).tobytes()
+
+
+def fit_pil():
+    draw = ImageDraw.Draw(Image.new("1", (1, 1)))
+
+    for line1, line2 in SCREENS:
+        app.calculate_font_size(draw, line1, app.FONT_NAME)
+        app.calculate_font_size(draw, line2, app.FONT_NAME)
+
+
+def fit_native():
+    for line1, line2 in SCREENS:
+        for text in (line1, line2):
+            if text:
+                ehymnboard_render.fit_font_size(app.FONT_NAME, text, app.MAX_LINE_WIDTH, app.MAX_FONT_SIZE)
+
+
+def pack_pil():
+    pack_pixels(IMAGE)
+
+
+def pack_native():
+    IMAGE.tobytes()
+
+
+def render_all(render):
+    return [render(line1, line2) for line1, line2 in SCREENS]
+
+
+def best_time_ms(function) -> float:
+    """Fastest of a few rounds, in ms per screen."""
+    best = None
+
+    for _ in range(ROUNDS):
+        start = time.perf_counter()
+        function()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+
+    return best * 1000 / len(SCREENS)
+
+
+IMAGE = app.render_lines(*SCREENS[0])
+
+
+def main():
+    print(f"{'ms per screen':<24}{'PIL':>10}{'native':>10}{'speedup':>10}")
+
+    for name, pil, native in [
+        ("Font size search", fit_pil, fit_native),
+        ("Packing", pack_pil, pack_native),
+        ("Whole screen", lambda: render_all(render_pil), lambda: render_all(render_native)),
+    ]:
+        pil_ms = best_time_ms(pil)
+        native_ms = best_time_ms(native)
+        print(f"{name:<24}{pil_ms:>10.2f}{native_ms:>10.2f}{pil_ms / native_ms:>9.0f}x")
+
+    # The native renderer places glyphs on whole pixels, where PIL may round
+    # them a pixel differently
+    for (line1, line2), pil, native in zip(SCREENS, render_all(render_pil), render_all(render_native)):
+        differing = sum(bin(a ^ b).count("1") for a, b in zip(pil, native))
+        drawn = sum(bin(a).count("1") for a in pil)
+        print(f"{line1!r}, {line2!r}: {differing} of {drawn} text pixels differ")
+
+
+if __name__ == "__main__":
+    main()
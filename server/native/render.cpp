@@ -0,0 +1,469 @@
+/*
+ * eHymnBoard web app and backend server
+ * Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as
+ * published by the Free Software Foundation, either version 3 of the
+ * License, or (at your option) any later version.
+
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// The ehymnboard_render module: draws the lines of a screen with FreeType
+// straight into the packed 1 bit per pixel layout the device expects, rows
+// top to bottom and the leftmost pixel in the most significant bit. Used by
+// app.py instead of PIL when it is installed, see setup.py.
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cmath>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace
+{
+
+// Rows of glyph bitmaps are padded to this many bytes plus one, so they can
+// be read 7 bytes at a time with 8 byte loads
+constexpr int WORD_BYTES = 7;
+
+FT_Library library = nullptr;
+
+uint64_t load_be64(const uint8_t *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+void store_be64(uint8_t *data, uint64_t value)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    memcpy(data, &value, sizeof(value));
+}
+
+struct Glyph
+{
+    bool loaded = false;
+    // In 26.6 fixed point, like FreeType's own metrics
+    FT_Pos advance = 0;
+
+    bool rendered = false;
+    int left = 0;
+    int top = 0;
+    int rows = 0;
+    int row_bytes = 0;
+    // Monochrome, `row_bytes + 1` bytes per row
+    std::vector<uint8_t> bitmap;
+};
+
+// The glyphs of a font at one pixel size, kept once loaded since the same few
+// characters get measured and drawn over and over
+struct SizedFont
+{
+    int ascender = 0;
+    std::unordered_map<FT_UInt, Glyph> glyphs;
+};
+
+class Font
+{
+  public:
+    ~Font()
+    {
+        if (face)
+        {
+            FT_Done_Face(face);
+        }
+    }
+
+    // Sets an OSError and returns false on failure
+    bool open(const char *path)
+    {
+        if (FT_New_Face(library, path, 0, &face) != 0)
+        {
+            face = nullptr;
+            PyErr_Format(PyExc_OSError, "cannot open font %s", path);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Width of the text in 26.6 fixed point, or -1 with a Python error set
+    FT_Pos length(PyObject *text, int size)
+    {
+        FT_Pos pen = 0;
+        bool ok = layout(text, size, false, [&](const Glyph &, FT_Pos) {}, pen);
+
+        return ok ? pen : -1;
+    }
+
+    // Draws the text with its top left corner at x, y. Returns false with a
+    // Python error set on failure.
+    bool draw(PyObject *text, int size, double x, double y, uint8_t *frame, int width, int height)
+    {
+        auto &sized = select(size);
+
+        if (PyErr_Occurred())
+        {
+            return false;
+        }
+
+        auto baseline = (int)std::lround(y) + sized.ascender;
+        FT_Pos pen = std::lround(x * 64);
+
+        return layout(
+            text, size, true,
+            [&](const Glyph &glyph, FT_Pos start) {
+                blit(glyph, ((start + 32) >> 6) + glyph.left, baseline - glyph.top, frame, width, height);
+            },
+            pen);
+    }
+
+  private:
+    // Walks the glyphs of the text, with kerning, calling `visit` with each
+    // glyph and the pen position it starts at. Advances `pen` past the text.
+    template <typename Visit>
+    bool layout(PyObject *text, int size, bool render, Visit &&visit, FT_Pos &pen)
+    {
+        select(size);
+
+        if (PyErr_Occurred())
+        {
+            return false;
+        }
+
+        FT_UInt previous = 0;
+        auto length = PyUnicode_GET_LENGTH(text);
+
+        for (Py_ssize_t i = 0; i < length; i++)
+        {
+            auto index = FT_Get_Char_Index(face, PyUnicode_READ_CHAR(text, i));
+
+            if (previous && index && FT_HAS_KERNING(face))
+            {
+                FT_Vector delta;
+
+                if (FT_Get_Kerning(face, previous, index, FT_KERNING_DEFAULT, &delta) == 0)
+                {
+                    pen += delta.x;
+                }
+            }
+
+            auto glyph = load(size, index, render);
+
+            if (!glyph)
+            {
+                return false;
+            }
+
+            visit(*glyph, pen);
+            pen += glyph->advance;
+            previous = index;
+        }
+
+        return true;
+    }
+
+    // Sets the face to the size, which FreeType only allows one of at a time
+    SizedFont &select(int size)
+    {
+        auto &sized = sizes[size];
+
+        if (size != current_size)
+        {
+            if (FT_Set_Pixel_Sizes(face, 0, size) != 0)
+            {
+                PyErr_Format(PyExc_ValueError, "invalid font size %d", size);
+                return sized;
+            }
+
+            current_size = size;
+            sized.ascender = (int)((face->size->metrics.ascender + 32) >> 6);
+        }
+
+        return sized;
+    }
+
+    // Hinted for monochrome, so the advances match what is drawn
+    const Glyph *load(int size, FT_UInt index, bool render)
+    {
+        auto &glyph = sizes[size].glyphs[index];
+
+        if (glyph.loaded && (glyph.rendered || !render))
+        {
+            return &glyph;
+        }
+
+        auto flags = FT_LOAD_TARGET_MONO | (render ? FT_LOAD_RENDER : 0);
+
+        if (FT_Load_Glyph(face, index, flags) != 0)
+        {
+            PyErr_Format(PyExc_RuntimeError, "cannot load glyph %u", index);
+            return nullptr;
+        }
+
+        auto slot = face->glyph;
+        glyph.loaded = true;
+        glyph.advance = slot->advance.x;
+
+        if (render)
+        {
+            auto &bitmap = slot->bitmap;
+
+            glyph.rendered = true;
+            glyph.left = slot->bitmap_left;
+            glyph.top = slot->bitmap_top;
+            glyph.rows = bitmap.rows;
+            glyph.row_bytes = ((int)(bitmap.width + 7) / 8 + WORD_BYTES - 1) / WORD_BYTES * WORD_BYTES;
+            glyph.bitmap.assign((size_t)glyph.rows * (glyph.row_bytes + 1), 0);
+
+            for (int row = 0; row < glyph.rows; row++)
+            {
+                memcpy(&glyph.bitmap[row * (glyph.row_bytes + 1)], bitmap.buffer + row * bitmap.pitch,
+                       (bitmap.width + 7) / 8);
+            }
+        }
+
+        return &glyph;
+    }
+
+    // ORs the glyph into the frame with its top left corner at x, y, shifting
+    // 7 bytes of a row into place at a time as one 64 bit word
+    static void blit(const Glyph &glyph, int x, int y, uint8_t *frame, int width, int height)
+    {
+        auto stride = width / 8;
+        auto byte_x = x >= 0 ? x / 8 : (x - 7) / 8;
+        auto shift = x - byte_x * 8;
+
+        for (int row = 0; row < glyph.rows; row++)
+        {
+            if (y + row < 0 || y + row >= height)
+            {
+                continue;
+            }
+
+            auto src = &glyph.bitmap[row * (glyph.row_bytes + 1)];
+            auto dst = frame + (y + row) * stride;
+
+            for (int i = 0; i < glyph.row_bytes; i += WORD_BYTES)
+            {
+                auto bits = (load_be64(src + i) & ~(uint64_t)0xFF) >> shift;
+                auto dst_x = byte_x + i;
+
+                if (dst_x >= 0 && dst_x + 8 <= stride)
+                {
+                    store_be64(dst + dst_x, load_be64(dst + dst_x) | bits);
+                    continue;
+                }
+
+                // Clipped at the edge of the frame
+                for (int j = 0; j < 8; j++)
+                {
+                    if (dst_x + j >= 0 && dst_x + j < stride)
+                    {
+                        dst[dst_x + j] |= (uint8_t)(bits >> (56 - 8 * j));
+                    }
+                }
+            }
+        }
+    }
+
+    FT_Face face = nullptr;
+    int current_size = 0;
+    std::unordered_map<int, SizedFont> sizes;
+};
+
+// Opened fonts by path. Only touched with the GIL held.
+std::unordered_map<std::string, std::unique_ptr<Font>> fonts;
+
+Font *get_font(const char *path)
+{
+    auto &font = fonts[path];
+
+    if (!font)
+    {
+        auto opened = std::make_unique<Font>();
+
+        if (!opened->open(path))
+        {
+            fonts.erase(path);
+            return nullptr;
+        }
+
+        font = std::move(opened);
+    }
+
+    return font.get();
+}
+
+PyObject *text_length(PyObject *, PyObject *args)
+{
+    const char *path;
+    PyObject *text;
+    int size;
+
+    if (!PyArg_ParseTuple(args, "sUi", &path, &text, &size))
+    {
+        return nullptr;
+    }
+
+    auto font = get_font(path);
+    auto length = font ? font->length(text, size) : -1;
+
+    return length >= 0 ? PyFloat_FromDouble(length / 64.0) : nullptr;
+}
+
+PyObject *fit_font_size(PyObject *, PyObject *args)
+{
+    const char *path;
+    PyObject *text;
+    double max_width;
+    double max_size;
+
+    if (!PyArg_ParseTuple(args, "sUdd", &path, &text, &max_width, &max_size))
+    {
+        return nullptr;
+    }
+
+    auto font = get_font(path);
+
+    if (!font)
+    {
+        return nullptr;
+    }
+
+    // Text gets wider with the size, so search for the last size that fits
+    int low = 0;
+    int high = (int)max_size;
+
+    while (low < high)
+    {
+        auto size = (low + high + 1) / 2;
+        auto length = font->length(text, size);
+
+        if (length < 0)
+        {
+            return nullptr;
+        }
+
+        if (length < max_width * 64)
+        {
+            low = size;
+        }
+        else
+        {
+            high = size - 1;
+        }
+    }
+
+    return PyLong_FromLong(low);
+}
+
+PyObject *render(PyObject *, PyObject *args)
+{
+    const char *path;
+    int width;
+    int height;
+    PyObject *lines;
+
+    if (!PyArg_ParseTuple(args, "siiO", &path, &width, &height, &lines))
+    {
+        return nullptr;
+    }
+
+    if (width <= 0 || width % 8 != 0 || height <= 0)
+    {
+        PyErr_SetString(PyExc_ValueError, "width must be a positive multiple of 8 and height positive");
+        return nullptr;
+    }
+
+    auto font = get_font(path);
+    auto sequence = font ? PySequence_Fast(lines, "lines must be a sequence") : nullptr;
+
+    if (!sequence)
+    {
+        return nullptr;
+    }
+
+    auto frame = PyBytes_FromStringAndSize(nullptr, (Py_ssize_t)width / 8 * height);
+
+    if (!frame)
+    {
+        Py_DECREF(sequence);
+        return nullptr;
+    }
+
+    auto data = (uint8_t *)PyBytes_AS_STRING(frame);
+    memset(data, 0, PyBytes_GET_SIZE(frame));
+
+    for (Py_ssize_t i = 0; i < PySequence_Fast_GET_SIZE(sequence); i++)
+    {
+        PyObject *text;
+        int size;
+        double x;
+        double y;
+
+        if (!PyArg_ParseTuple(PySequence_Fast_GET_ITEM(sequence, i), "Uidd", &text, &size, &x, &y) ||
+            !font->draw(text, size, x, y, data, width, height))
+        {
+            Py_DECREF(sequence);
+            Py_DECREF(frame);
+            return nullptr;
+        }
+    }
+
+    Py_DECREF(sequence);
+    return frame;
+}
+
+PyMethodDef methods[] = {
+    {"text_length", text_length, METH_VARARGS,
+     "text_length(font_path, text, size) -> float\n\nWidth of the text in pixels at the size."},
+    {"fit_font_size", fit_font_size, METH_VARARGS,
+     "fit_font_size(font_path, text, max_width, max_size) -> int\n\n"
+     "Largest size of at most max_size the text is narrower than max_width at, or 0."},
+    {"render", render, METH_VARARGS,
+     "render(font_path, width, height, lines) -> bytes\n\n"
+     "Draws (text, size, x, y) lines, each with its top left corner at x, y, and returns the frame packed\n"
+     "1 bit per pixel with the leftmost pixel in the most significant bit. Set bits are text."},
+    {nullptr, nullptr, 0, nullptr},
+};
+
+PyModuleDef module = {
+    PyModuleDef_HEAD_INIT, "ehymnboard_render", "Renders screens for the eHymnBoard devices.", -1, methods,
+};
+
+} // namespace
+
+PyMODINIT_FUNC PyInit_ehymnboard_render()
+{
+    if (!library && FT_Init_FreeType(&library) != 0)
+    {
+        PyErr_SetString(PyExc_ImportError, "cannot initialize FreeType");
+        return nullptr;
+    }
+
+    return PyModule_Create(&module);
+}
@@ -0,0 +1,49 @@
+# eHymnBoard web app and backend server
+# Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+# Builds the ehymnboard_render extension, which needs a C++ compiler and the
+# FreeType headers, e.g. from libfreetype-dev. Install it with:
+#
+#    pip install ./native
+
+import subprocess
+from setuptools import Extension, setup
+
+
+def freetype_flags(option: str) -> list:
+    try:
+        output = subprocess.run(
+            ["pkg-config", option, "freetype2"], capture_output=True, check=True, text=True
+        ).stdout
+    except (OSError, subprocess.CalledProcessError):
+        return []
+
+    return [flag[2:] for flag in output.split()]
+
+
+setup(
+    name="ehymnboard-render",
+    version="1.0.0",
+    ext_modules=[
+        Extension(
+            "ehymnboard_render",
+            sources=["render.cpp"],
+            include_dirs=freetype_flags("--cflags-only-I") or ["/usr/include/freetype2"],
+            libraries=["freetype"],
+            extra_compile_args=["-std=c++17", "-O2"],
+        )
+    ],
+)
@@ -0,0 +1,88 @@
+# eHymnBoard web app and backend server
+# Copyright (C) 2025  Michael Spencer <sonrisesoftware@gmail.com>
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Affero General Public License as
+# published by the Free Software Foundation, either version 3 of the
+# License, or (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU Affero General Public License for more details.
+#
+# You should have received a copy of the GNU Affero General Public License
+# along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+
+# Measures how much PackBits shrinks rendered screens, which is what devices
+# download instead of the raw frames, and how long encoding takes. Given a
+# directory, it also writes each screen there as <n>.frame and <n>.packbits,
+# for the decoder benchmark of the host build in device/host. Run from the
+# server directory:
+#
+#    python packbits_benchmark.py [directory]
+
+import os
+import sys
+import time
+
+# The app, which loads its fonts relative to the server directory
+sys.path.insert(0, os.getcwd())
+import app  # noqa: E402
+
+SCREENS = [
+    ("123", "456"),
+    ("LSB 457", "vv. 1-4"),
+    ("Psalm 23", ""),
+    ("Hymn 801 vv. 1-4", "Offertory"),
+    ("", ""),
+]
+ROUNDS = 5
+
+
+def best_time_ms(function) -> float:
+    """Fastest of a few rounds, in ms."""
+    best = None
+
+    for _ in range(ROUNDS):
+        start = time.perf_counter()
+        function()
+        elapsed = time.perf_counter() - start
+        best = elapsed if best is None else min(best, elapsed)
+
+    return best * 1000
+
+
+def main():
+    output_dir = sys.argv[1] if len(sys.argv) > 1 else None
+    total_raw = 0
+    total_encoded = 0
+
+    print(f"{'screen':<36}{'raw':>8}{'packbits':>10}{'ratio':>8}{'encode ms':>11}")
+
+    for i, (line1, line2) in enumerate(SCREENS, 1):
+        frame = app.image_to_buffer(app.render_lines(line1, line2))
+        encoded = app.packbits_encode(frame)
+        encode_ms = best_time_ms(lambda: app.packbits_encode(frame))
+
+        total_raw += len(frame)
+        total_encoded += len(encoded)
+
+        name = f"{line1!r}, {line2!r}"
+        print(f"{name:<36}{len(frame):>8}{len(encoded):>10}{len(frame) / len(encoded):>7.0f}x{encode_ms:>11.1f}")
+
+        if output_dir:
+            os.makedirs(output_dir, exist_ok=True)
+
+            with open(os.path.join(output_dir, f"{i}.frame"), "wb") as f:
+                f.write(frame)
+
+            with open(os.path.join(output_dir, f"{i}.packbits"), "wb") as f:
+                f.write(encoded)
+
+    print(f"{'All screens':<36}{total_raw:>8}{total_encoded:>10}{total_raw / total_encoded:>7.0f}x")
+
+
+if __name__ == "__main__":
+    main()